@@ -13,7 +13,7 @@
 // Run: ./numbers [OPTION(S)]... [NUMBER(S)]...
 // If any of the NUMBERS are negative, the first must be preceded by a --.
 
-// Optionally configure the program to use an external factor command instead of the builtin prime factorization functionality. This may be faster when factoring some very large numbers, but slower when factoring large ranges of numbers. Just set the FACTOR define below to the factor command path, for example: "/usr/bin/factor". Alternatively, add the -DFACTOR='"<path>"' option when comping the program, for example -DFACTOR='"/usr/bin/factor"'.
+// Optionally configure the program to also use an external factor command for large numbers. The builtin prime factorization functionality is still used for the composites left by trial division below --factor-threshold bits (256 by default), as it is faster for most numbers, unless --factor-backend external is used. Run the program with --calibrate to find the number of bits from which the command is faster on your computer. The command is started once and must output a line for each number on its standard input, like the GNU and uutils factor commands. Just set the FACTOR define below to the factor command path, for example: "/usr/bin/factor". Alternatively, add the -DFACTOR='"<path>"' option when comping the program, for example -DFACTOR='"/usr/bin/factor"'.
 
 // On Linux distributions with GNU Coreutils older than 9.0, including Ubuntu (https://bugs.launchpad.net/ubuntu/+source/coreutils/+bug/696618) and Debian (https://bugs.debian.org/cgi-bin/bugreport.cgi?bug=608832), the factor command (part of GNU Coreutils) is built without arbitrary-precision/bignum support. If this is the case on your system and you are compiling this program with GMP, you would also need to build the factor command with GMP.
 
@@ -55,6 +55,9 @@
 	Copy factor command to starting directory
 	cp --reflink=auto ./target/release/factor "$DIRNAME/" */
 
+// factor command
+// #define FACTOR "factor"
+
 #include <iostream>
 #include <sstream>
 #include <cstring>
@@ -66,21 +69,37 @@
 #include <clocale>
 #include <array>
 #include <vector>
+#include <memory>
 #include <numeric>
 #include <algorithm>
 #include <cinttypes>
-#include <regex>
+#include <charconv>
+#include <random>
+#include <chrono>
 #include <bit>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <map>
 #include <getopt.h>
+#include <unistd.h>
+#ifdef FACTOR
+#include <fcntl.h>
+#include <termios.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#endif
+#if defined(__x86_64__) or defined(__i386__)
+#include <immintrin.h>
+#endif
 #if HAVE_GMP
 #include <gmpxx.h>
 #endif
 
 using namespace std;
 
-// factor command
-// #define FACTOR "factor"
-
 enum
 {
 	// DEV_DEBUG_OPTION = CHAR_MAX + 1,
@@ -97,6 +116,23 @@ enum
 	// BASE36_OPTION,
 	BRAILLE_OPTION,
 	SPECIAL_OPTION,
+	BPSW_OPTION,
+	ECM_B1_OPTION,
+	ECM_B2_OPTION,
+	ECM_CURVES_OPTION,
+	THREADS_OPTION,
+	SIGMA_OPTION,
+	TAU_OPTION,
+	TOTIENT_OPTION,
+	KTH_DIVISOR_OPTION,
+	DIVISORS_BETWEEN_OPTION,
+	LARGEST_DIVISOR_OPTION,
+	FACTOR_BACKEND_OPTION,
+	FACTOR_THRESHOLD_OPTION,
+	CALIBRATE_OPTION,
+	RANGE_OPTION,
+	PRIMES_OPTION,
+	PRIME_COUNT_OPTION,
 	ASCII_OPTION,
 	UPPER_OPTION,
 	GETOPT_HELP_CHAR = CHAR_MIN - 2,
@@ -115,6 +151,19 @@ const char *const scale_to_args[] = {"none", "si", "iec", "iec-i"};
 
 enum scale_type const scale_to_types[] = {scale_none, scale_SI, scale_IEC, scale_IEC_I};
 
+#ifdef FACTOR
+enum factor_backend
+{
+	backend_builtin,
+	backend_external,
+	backend_auto
+};
+
+const char *const factor_backend_args[] = {"builtin", "external", "auto"};
+
+enum factor_backend const factor_backend_types[] = {backend_builtin, backend_external, backend_auto};
+#endif
+
 const char *const suffix_power_char[] = {"", "K", "M", "G", "T", "P", "E", "Z", "Y", "R", "Q"};
 
 const char *const roman[][2][13] = {
@@ -168,7 +217,7 @@ const char *const exponents[] = {"⁰", "¹", "²", "³", "⁴", "⁵", "⁶", "
 const char *const fractions[] = {"¼", "½", "¾", "⅐", "⅑", "⅒", "⅓", "⅔", "⅕", "⅖", "⅗", "⅘", "⅙", "⅚", "⅛", "⅜", "⅝", "⅞"};
 const long double fractionvalues[] = {1.0L / 4.0L, 1.0L / 2.0L, 3.0L / 4.0L, 1.0L / 7.0L, 1.0L / 9.0L, 1.0L / 10.0L, 1.0L / 3.0L, 2.0L / 3.0L, 1.0L / 5.0L, 2.0L / 5.0L, 3.0L / 5.0L, 4.0L / 5.0L, 1.0L / 6.0L, 5.0L / 6.0L, 1.0L / 8.0L, 3.0L / 8.0L, 5.0L / 8.0L, 7.0L / 8.0L};
 
-const regex re("^.*: ");
+const char *const primality[] = {"Composite (Not prime)", "Prime!"};
 
 const char *const constants[] = {"π", "e"};
 const long double constantvalues[] = {M_PI, M_E};
@@ -190,10 +239,47 @@ bool dev_debug = false;
 /* Prove primality or run probabilistic tests.  */
 bool flag_prove_primality = true;
 
-#ifndef FACTOR
+/* Run the Baillie-PSW test instead of proving primality or running
+   probabilistic tests.  */
+bool flag_bpsw = false;
+
+/* Stage 1 and stage 2 bounds and number of curves for the elliptic curve
+   method, or 0 for the defaults.  */
+uint64_t ecm_b1 = 0;
+uint64_t ecm_b2 = 0;
+size_t ecm_curves = 0;
+
+/* Number of threads for factoring large composites and expanding divisors,
+   or 0 for one on each core.  */
+unsigned factor_threads = 0;
+
+/* Power of the divisors to sum with --sigma-k.  */
+unsigned long sigma_k = 1;
+
+/* Position of the divisor to output with --kth-divisor, counting from 1, and
+   the bounds of the divisors to output with --divisors-between and
+   --largest-divisor.  */
+uintmax_t divisor_k = 1;
+const char *divisors_from = nullptr;
+const char *divisors_to = nullptr;
+
+#ifdef FACTOR
+/* Prime factorization to use, and the number of bits from which
+   backend_auto uses the factor command for the composites left by trial
+   division.  */
+factor_backend backend = backend_auto;
+size_t factor_threshold = 256;
+#endif
+
+/* Largest power of the divisors for --sigma-k, as p^K is computed exactly and
+   has K times as many digits as p.  */
+constexpr unsigned long SIGMA_MAX_K = 1000;
+
+/* Largest ECM bound, as the primes come from for_each_prime().  */
+constexpr uint64_t ECM_MAX_B2 = UINT32_MAX;
+
 /* Number of Miller-Rabin tests to run when not proving primality.  */
 constexpr int MR_REPS = 24;
-#endif
 
 template <size_t N>
 constexpr auto primes()
@@ -238,7 +324,11 @@ constexpr auto primes()
 		return nprimes;
 	}(sieve);
 	array<unsigned char, nprimes> primes{};
-	// array<unsigned __int128, nprimes> magic{};
+	/* Inverses of the primes modulo 2^128 and the largest multiples of them
+	   times the inverses can give.  The values modulo 2^64 are the low and
+	   high halves.  */
+	array<unsigned __int128, nprimes> inverses{};
+	array<unsigned __int128, nprimes> limits{};
 
 	size_t p = 2;
 	for (size_t i = 0, j = 0; i < size; ++i)
@@ -247,7 +337,13 @@ constexpr auto primes()
 		{
 			const size_t ap = 3 + 2 * i;
 			primes[j] = ap - p;
-			// magic[j] = UINT128_MAX / ap + 1;
+			/* Newton's method, each step doubles the number of correct low bits
+			   from the three of ap.  */
+			unsigned __int128 inv = ap;
+			for (size_t k = 0; k < 6; ++k)
+				inv *= 2 - ap * inv;
+			inverses[j] = inv;
+			limits[j] = UINT128_MAX / ap;
 			++j;
 			p = ap;
 		}
@@ -270,8 +366,7 @@ constexpr auto primes()
 		}
 	} while (!is_prime);
 
-	// return tuple{primes, magic, p};
-	return tuple{primes, p};
+	return tuple{primes, inverses, limits, p};
 }
 
 // constexpr auto [primes_diff, FIRST_OMITTED_PRIME] = primes<1u << 16>(); // 2^16 = 65536
@@ -280,7 +375,9 @@ constexpr auto primes()
 constexpr auto temp = primes<1u << 16>(); // 2^16 = 65536
 // constexpr auto temp = primes<500000>();
 constexpr auto &primes_diff = get<0>(temp);
-constexpr auto &FIRST_OMITTED_PRIME = get<1>(temp);
+constexpr auto &primes_inv = get<1>(temp);
+constexpr auto &primes_lim = get<2>(temp);
+constexpr auto &FIRST_OMITTED_PRIME = get<3>(temp);
 
 constexpr size_t PRIMES_PTAB_ENTRIES = size(primes_diff);
 static_assert(PRIMES_PTAB_ENTRIES >= sizeof(unsigned __int128));
@@ -295,7 +392,6 @@ static_assert(FIRST_OMITTED_PRIME == 65537);
 
 constexpr auto SQUARE_OF_FIRST_OMITTED_PRIME = FIRST_OMITTED_PRIME * FIRST_OMITTED_PRIME;
 
-#ifndef FACTOR
 #if HAVE_GMP
 template <typename T>
 mpz_class import(const T &value)
@@ -318,7 +414,6 @@ T aexport(const mpz_class &value)
 // const mpz_class aINT128_MAX = (mpz_class(1) << 127) - 1;
 const mpz_class aINT128_MAX = import(INT128_MAX);
 #endif
-#endif
 
 /* Number of bits in an uintmax_t.  */
 constexpr size_t W = sizeof(uintmax_t) * CHAR_BIT;
@@ -1080,37 +1175,11 @@ string outputhextext(const T &number)
 	return str;
 }
 
-// Execute command
-int exec(const char *const cmd, string &result)
-{
-	FILE *pipe = popen(cmd, "r");
-	if (!pipe)
-		throw runtime_error("popen() failed!");
-	try
-	{
-		char buffer[128];
-		while (fgets(buffer, sizeof(buffer), pipe))
-		{
-			result += buffer;
-		}
-		if (!result.empty())
-			result.erase(result.length() - 1);
-	}
-	catch (...)
-	{
-		pclose(pipe);
-		throw;
-	}
-	return pclose(pipe);
-}
-
-#ifndef FACTOR
 template <typename T>
 constexpr T diff(const T a, const T b)
 {
 	return a >= b ? a - b : b - a;
 }
-#endif
 
 template <typename T>
 constexpr T mulm(T a, T b, const T mod)
@@ -1132,11 +1201,263 @@ constexpr T mulm(T a, T b, const T mod)
 	return res;
 }
 
+/* Modular arithmetic in Montgomery form for odd moduli N, where a value A is
+   stored as A * R mod N with R = 2^W.  A modular multiplication is then a
+   double-width multiplication followed by a REDC reduction, with no division.
+   For unsigned __int128, the 256-bit intermediate products are built from
+   64 x 64 -> 128-bit hardware multiplications.
+   Adapted from: https://github.com/coreutils/coreutils/blob/master/src/factor.c  */
+template <typename T>
+class montgomery
+{
+	static_assert(is_integral_v<T> and is_unsigned_v<T>);
+	static_assert(sizeof(T) <= sizeof(unsigned __int128));
+
+	static constexpr int digits = numeric_limits<T>::digits;
+
+	T n = 1;
+	T ni = 1;
+	T r1 = 0;
+	T r2 = 0;
+
+	/* Inverse of odd N modulo 2^W using Newton's iteration, which doubles the
+	   number of correct low bits each step.  */
+	static constexpr T inverse(const T n)
+	{
+		T inv = n; /* Correct to 3 bits, since n * n == 1 (mod 8).  */
+		for (int bits = 3; bits < digits; bits *= 2)
+			inv *= 2 - n * inv;
+
+		return inv;
+	}
+
+	static constexpr void mul_wide(const T a, const T b, T &hi, T &lo)
+	{
+		if constexpr (sizeof(T) > sizeof(uint64_t))
+		{
+			const uint64_t a0 = a, a1 = a >> 64;
+			const uint64_t b0 = b, b1 = b >> 64;
+
+			const unsigned __int128 p00 = (unsigned __int128)a0 * b0;
+			const unsigned __int128 p01 = (unsigned __int128)a0 * b1;
+			const unsigned __int128 p10 = (unsigned __int128)a1 * b0;
+			const unsigned __int128 p11 = (unsigned __int128)a1 * b1;
+
+			/* Middle limb, which cannot overflow: < 3 * 2^64.  */
+			const unsigned __int128 mid = (p00 >> 64) + (uint64_t)p01 + (uint64_t)p10;
+
+			lo = (mid << 64) | (uint64_t)p00;
+			hi = p11 + (p01 >> 64) + (p10 >> 64) + (mid >> 64);
+		}
+		else
+		{
+			const unsigned __int128 p = (unsigned __int128)a * b;
+			hi = p >> digits;
+			lo = p;
+		}
+	}
+
+	/* Compute (hi * R + lo) / R mod N, where hi < N.  */
+	constexpr T redc(const T hi, const T lo) const
+	{
+		T mh, ml;
+		mul_wide(lo * ni, n, mh, ml);
+		return hi >= mh ? hi - mh : hi - mh + n;
+	}
+
+public:
+	using value_type = T;
+
+	constexpr montgomery() = default;
+
+	constexpr explicit montgomery(const T n) : n(n), ni(inverse(n)), r1(T(-n) % n), r2(r1)
+	{
+		// assert(n & 1);
+		if constexpr (sizeof(T) > sizeof(uint64_t))
+		{
+			/* R^2 mod N by doubling R mod N, W more times.  */
+			for (int i = 0; i < digits; ++i)
+				r2 = add(r2, r2);
+		}
+		else
+			r2 = (unsigned __int128)r1 * r1 % n;
+	}
+
+	constexpr const T &modulus() const
+	{
+		return n;
+	}
+
+	/* N^-1 mod R.  */
+	constexpr const T &modulus_inverse() const
+	{
+		return ni;
+	}
+
+	/* 1 and N - 1 in Montgomery form.  */
+	constexpr T one() const
+	{
+		return r1;
+	}
+
+	constexpr T minus_one() const
+	{
+		return n - r1;
+	}
+
+	/* Convert A < N to and from Montgomery form.  */
+	constexpr T to(const T a) const
+	{
+		return mul(a, r2);
+	}
+
+	constexpr T from(const T a) const
+	{
+		return redc(0, a);
+	}
+
+	constexpr T add(const T a, const T b) const
+	{
+		const T sum = a + b;
+		return sum < a or sum >= n ? sum - n : sum;
+	}
+
+	constexpr T sub(const T a, const T b) const
+	{
+		return a >= b ? a - b : a - b + n;
+	}
+
+	/* A / 2 mod N, which is the same in Montgomery form.  */
+	constexpr T half(const T a) const
+	{
+		return (a & 1) != 0 ? (a >> 1) + (n >> 1) + 1 : a >> 1;
+	}
+
+	constexpr T mul(const T a, const T b) const
+	{
+		T hi, lo;
+		mul_wide(a, b, hi, lo);
+		return redc(hi, lo);
+	}
+
+	/* Compute base^exp, where base and the result are in Montgomery form.  */
+	constexpr T pow(T base, T exp) const
+	{
+		T res = r1;
+
+		for (; exp != 0; exp >>= 1)
+		{
+			if ((exp & 1) != 0)
+				res = mul(res, base);
+
+			base = mul(base, base);
+		}
+
+		return res;
+	}
+};
+
+#if HAVE_GMP
+/* Modular arithmetic for arbitrary-precision moduli, with the same interface
+   as montgomery<T>, but with the values stored as they are.  */
+class mpz_modular
+{
+	mpz_class n;
+
+public:
+	using value_type = mpz_class;
+
+	explicit mpz_modular(const mpz_class &n) : n(n)
+	{
+	}
+
+	const mpz_class &modulus() const
+	{
+		return n;
+	}
+
+	mpz_class one() const
+	{
+		return 1;
+	}
+
+	mpz_class minus_one() const
+	{
+		return n - 1;
+	}
+
+	mpz_class to(const mpz_class &a) const
+	{
+		return a;
+	}
+
+	mpz_class from(const mpz_class &a) const
+	{
+		return a;
+	}
+
+	mpz_class add(const mpz_class &a, const mpz_class &b) const
+	{
+		mpz_class sum = a + b;
+		if (sum >= n)
+			sum -= n;
+		return sum;
+	}
+
+	mpz_class sub(const mpz_class &a, const mpz_class &b) const
+	{
+		mpz_class difference = a - b;
+		if (difference < 0)
+			difference += n;
+		return difference;
+	}
+
+	mpz_class half(const mpz_class &a) const
+	{
+		mpz_class res = a;
+		if (mpz_odd_p(res.get_mpz_t()))
+			res += n;
+		res >>= 1;
+		return res;
+	}
+
+	mpz_class mul(const mpz_class &a, const mpz_class &b) const
+	{
+		mpz_class res = a * b;
+		mpz_mod(res.get_mpz_t(), res.get_mpz_t(), n.get_mpz_t());
+		return res;
+	}
+
+	mpz_class pow(const mpz_class &base, const mpz_class &exp) const
+	{
+		mpz_class res;
+		mpz_powm(res.get_mpz_t(), base.get_mpz_t(), exp.get_mpz_t(), n.get_mpz_t());
+		return res;
+	}
+};
+
+/* Modular arithmetic for odd moduli of type T.  */
+template <typename T>
+using modular = conditional_t<is_integral_v<T>, montgomery<T>, mpz_modular>;
+#else
+template <typename T>
+using modular = montgomery<T>;
+#endif
+
 template <typename T>
 constexpr T powm(T base, T exp, const T mod)
 {
 	static_assert(is_integral_v<T>);
 	// assert(mod>1);
+	if constexpr (is_unsigned_v<T>)
+	{
+		if ((mod & 1) != 0)
+		{
+			const montgomery<T> mont(mod);
+			return mont.from(mont.pow(mont.to(base % mod), exp));
+		}
+	}
+
 	T res = 1;
 
 	for (; exp != 0; exp >>= 1)
@@ -1152,10 +1473,36 @@ constexpr T powm(T base, T exp, const T mod)
 	return res;
 }
 
-#ifndef FACTOR
 template <typename T1, typename T2>
 void factor(T1 &t, map<T2, size_t> &factors);
 
+/* Return true if the Ith odd prime P divides T and store T / P in Q.
+   Integers use no division, as T times the inverse of P is at most the limit
+   exactly when P divides T, and is then T / P.  */
+template <typename T>
+bool divisible(const T &t, const size_t i, [[maybe_unused]] const size_t p, T &q)
+{
+#if HAVE_GMP
+	if constexpr (!is_integral_v<T>)
+	{
+		if (!mpz_divisible_ui_p(t.get_mpz_t(), p))
+			return false;
+		mpz_divexact_ui(q.get_mpz_t(), t.get_mpz_t(), p);
+		return true;
+	}
+	else
+#endif
+	{
+		using U = make_unsigned_t<T>;
+		constexpr size_t shift = numeric_limits<unsigned __int128>::digits - numeric_limits<U>::digits;
+		const U aq = U(t) * U(primes_inv[i]);
+		if (aq > U(primes_lim[i] >> shift))
+			return false;
+		q = aq;
+		return true;
+	}
+}
+
 template <typename T1, typename T2>
 void factor_using_division(T1 &t, map<T2, size_t> &factors)
 {
@@ -1180,9 +1527,10 @@ void factor_using_division(T1 &t, map<T2, size_t> &factors)
 		factors[2] += p;
 
 	p = 3;
+	T1 q;
 	for (size_t i = 1; i <= PRIMES_PTAB_ENTRIES;)
 	{
-		if (t % p != 0)
+		if (!divisible(t, i - 1, p, q))
 		{
 			if (i < PRIMES_PTAB_ENTRIES)
 				p += primes_diff[i];
@@ -1192,94 +1540,294 @@ void factor_using_division(T1 &t, map<T2, size_t> &factors)
 		}
 		else
 		{
-			// mpz_tdiv_q_ui(t.get_mpz_t(), t.get_mpz_t(), p);
-			t /= p;
+			t = q;
 			++factors[p];
 		}
 	}
 }
-#endif
 
-template <typename T>
-bool millerrabin(const T &n, const T &nm1, const T &x, const T &q, const size_t k)
+/* Miller-Rabin test with base X, where X is already in the form used by MONT.  */
+template <typename M, typename T>
+bool millerrabin(const M &mont, const T &x, const T &q, const size_t k)
 {
-	T y = 0;
-#if HAVE_GMP
-	if constexpr (!is_integral_v<T>)
-		mpz_powm(y.get_mpz_t(), x.get_mpz_t(), q.get_mpz_t(), n.get_mpz_t());
-	else
-#endif
-		y = powm(x, q, n);
+	const T one = mont.one();
+	const T nm1 = mont.minus_one();
+
+	T y = mont.pow(x, q);
 
-	if (y == 1 or y == nm1)
+	if (y == one or y == nm1)
 		return true;
 
 	for (size_t i = 1; i < k; ++i)
 	{
-#if HAVE_GMP
-		if constexpr (!is_integral_v<T>)
-			mpz_powm_ui(y.get_mpz_t(), y.get_mpz_t(), 2, n.get_mpz_t());
-		else
-#endif
-			// y = powm(y, T(2), n);
-			y = mulm(y, y, n);
+		y = mont.mul(y, y);
 
 		if (y == nm1)
 			return true;
-		if (y == 1)
+		if (y == one)
 			return false;
 	}
 	return false;
 }
 
-#ifndef FACTOR
+/* Integer square root, rounded down.  */
 template <typename T>
-bool prime_p(const T &n)
+T isqrt(const T &n)
 {
-	bool is_prime;
-	map<T, size_t> factors;
+	static_assert(is_integral_v<T>);
+	if (n < 2)
+		return n;
+
+	T x = T(1) << ((__bit_width(n) + 1) / 2);
+	for (T y = (x + n / x) / 2; y < x; y = (x + n / x) / 2)
+		x = y;
+
+	return x;
+}
+
+/* Integer K-th root, rounded down.  */
+template <typename T>
+T iroot(const T &n, const unsigned k)
+{
+	static_assert(is_integral_v<T>);
+	if (n < 2)
+		return n;
+
+	/* Newton's method from a power of 2 above the root.  Each x^(k - 1) is at
+	   most about n, so it does not overflow.  */
+	const auto power = [&](const T &x)
+	{
+		T p = 1;
+		for (unsigned i = 1; i < k; ++i)
+			p *= x;
+		return p;
+	};
+	T x = T(1) << ((__bit_width(n) + k - 1) / k);
+	for (T y = ((k - 1) * x + n / power(x)) / k; y < x; y = ((k - 1) * x + n / power(x)) / k)
+		x = y;
+
+	return x;
+}
+
+/* Jacobi symbol (A/N) for odd N.  */
+template <typename T>
+int jacobi(T a, T n)
+{
+	static_assert(is_integral_v<T>);
+	int t = 1;
+	a %= n;
+
+	while (a != 0)
+	{
+		const int z = __countr_zero(a);
+		a >>= z;
+		if ((z & 1) and ((n & 7) == 3 or (n & 7) == 5))
+			t = -t;
+		swap(a, n);
+		if ((a & 3) == 3 and (n & 3) == 3)
+			t = -t;
+		a %= n;
+	}
+
+	return n == 1 ? t : 0;
+}
 
+/* Strong Lucas probable prime test of odd N > 3, with Selfridge's parameters
+   P = 1 and Q = (1 - D) / 4, where D is the first of 5, -7, 9, -11, ... with
+   Jacobi symbol (D/N) = -1.
+   https://en.wikipedia.org/wiki/Lucas_pseudoprime#Strong_Lucas_pseudoprimes  */
+template <typename M>
+bool strong_lucas(const M &mont)
+{
+	using T = typename M::value_type;
+	const T &n = mont.modulus();
+
+	/* No D exists for perfect squares.  */
+#if HAVE_GMP
 	if constexpr (!is_integral_v<T>)
 	{
-		// n.fits_ulong_p()
-		if (n.fits_slong_p())
-		{
-			const unsigned long an = n.get_ui();
-			return prime_p(an);
-		}
+		if (mpz_perfect_square_p(n.get_mpz_t()))
+			return false;
+	}
+	else
+#endif
+	{
+		const T root = isqrt(n);
+		if (root * root == n)
+			return false;
+	}
+
+	long D = 5;
+	for (;; D = D > 0 ? -D - 2 : -D + 2)
+	{
+		int j = 0;
 #if HAVE_GMP
-		if constexpr (INTMAX_MAX > LONG_MAX and n <= INTMAX_MAX)
-		{
-			const uintmax_t an = aexport<uintmax_t>(n);
-			return prime_p(an);
-		}
-		if (n <= aINT128_MAX)
-		{
-			const auto an = aexport<unsigned __int128>(n);
-			return prime_p(an);
-		}
+		if constexpr (!is_integral_v<T>)
+			j = mpz_si_kronecker(D, n.get_mpz_t());
+		else
+#endif
+			j = jacobi(D < 0 ? n - T(-D) % n : T(D), n);
+		if (j == -1)
+			break;
+		if (j == 0)
+			return n == T(labs(D));
+	}
+	const long Q = (1 - D) / 4;
+
+	/* Constants in the form used by MONT.  */
+	const T d = D < 0 ? mont.sub(0, mont.to(T(-D))) : mont.to(T(D));
+	const T q = Q < 0 ? mont.sub(0, mont.to(T(-Q))) : mont.to(T(Q));
+
+	/* Find d and s, where d is odd and n + 1 = 2**s * d.  */
+	const T np1 = n + 1;
+	size_t s = 0;
+	size_t bits = 0;
+	T e = np1;
+#if HAVE_GMP
+	if constexpr (!is_integral_v<T>)
+	{
+		s = mpz_scan1(np1.get_mpz_t(), 0);
+		mpz_tdiv_q_2exp(e.get_mpz_t(), np1.get_mpz_t(), s);
+		bits = mpz_sizeinbase(e.get_mpz_t(), 2);
+	}
+	else
 #endif
+	{
+		s = __countr_zero(np1);
+		e >>= s;
+		bits = __bit_width(e);
 	}
-	else if constexpr (is_same_v<T, unsigned __int128>)
+
+	/* Compute U_e, V_e and Q^e from the most significant bit of e down.  */
+	T U = mont.one();
+	T V = mont.one();
+	T Qk = q;
+	for (size_t i = bits - 1; i-- > 0;)
 	{
-		if (n <= INTMAX_MAX)
+		U = mont.mul(U, V);
+		V = mont.sub(mont.mul(V, V), mont.add(Qk, Qk));
+		Qk = mont.mul(Qk, Qk);
+
+		bool bit = false;
+#if HAVE_GMP
+		if constexpr (!is_integral_v<T>)
+			bit = mpz_tstbit(e.get_mpz_t(), i);
+		else
+#endif
+			bit = ((e >> i) & 1) != 0;
+		if (bit)
 		{
-			const uintmax_t an = n;
-			return prime_p(an);
+			const T aU = U;
+			U = mont.half(mont.add(U, V));
+			V = mont.half(mont.add(mont.mul(d, aU), V));
+			Qk = mont.mul(Qk, q);
 		}
 	}
 
-	if (n <= 1)
-		return false;
-
-	/* We have already casted out small primes.  */
-	if (n < SQUARE_OF_FIRST_OMITTED_PRIME)
+	if (U == 0 or V == 0)
 		return true;
 
-	/* Precomputation for Miller-Rabin.  */
+	for (size_t r = 1; r < s; ++r)
+	{
+		V = mont.sub(mont.mul(V, V), mont.add(Qk, Qk));
+		if (V == 0)
+			return true;
+		Qk = mont.mul(Qk, Qk);
+	}
+
+	return false;
+}
+
+/* Baillie-PSW probable prime test of odd N > 3: a strong base 2 Miller-Rabin
+   test followed by a strong Lucas test.  There are no composites below 2^64
+   which pass it and no larger ones are known.
+   https://en.wikipedia.org/wiki/Baillie%E2%80%93PSW_primality_test  */
+template <typename M>
+bool bpsw(const M &mont)
+{
+	using T = typename M::value_type;
+	const T &n = mont.modulus();
 	const T nm1 = n - 1;
 
-	/* Find q and k, where q is odd and n = 1 + 2**k * q.  */
+	size_t k = 0;
+	T q = nm1;
+#if HAVE_GMP
+	if constexpr (!is_integral_v<T>)
+	{
+		k = mpz_scan1(nm1.get_mpz_t(), 0);
+		mpz_tdiv_q_2exp(q.get_mpz_t(), nm1.get_mpz_t(), k);
+	}
+	else
+#endif
+	{
+		k = __countr_zero(q);
+		q >>= k;
+	}
+
+	return millerrabin(mont, mont.to(2), q, k) and strong_lucas(mont);
+}
+
+/* If N fits in a narrower type than T, out of unsigned long, uintmax_t and
+   unsigned __int128, call F with it in the narrowest and return true.  */
+template <typename T, typename F>
+bool narrow(const T &n, F f)
+{
+	if constexpr (!is_integral_v<T>)
+	{
+		// n.fits_ulong_p()
+		if (n.fits_slong_p())
+		{
+			f(n.get_ui());
+			return true;
+		}
+#if HAVE_GMP
+		if constexpr (INTMAX_MAX > LONG_MAX)
+		{
+			if (n <= INTMAX_MAX)
+			{
+				f(aexport<uintmax_t>(n));
+				return true;
+			}
+		}
+		if (n <= aINT128_MAX)
+		{
+			f(aexport<unsigned __int128>(n));
+			return true;
+		}
+#endif
+	}
+	else if constexpr (is_same_v<T, unsigned __int128>)
+	{
+		if (n <= UINTMAX_MAX)
+		{
+			f(uintmax_t(n));
+			return true;
+		}
+	}
+	return false;
+}
+
+template <typename T>
+bool prime_p(const T &n)
+{
+	bool is_prime = false;
+	map<T, size_t> factors;
+
+	if (narrow(n, [&](const auto &an)
+			   { is_prime = prime_p(an); }))
+		return is_prime;
+
+	if (n <= 1)
+		return false;
+
+	/* We have already casted out small primes.  */
+	if (n < SQUARE_OF_FIRST_OMITTED_PRIME)
+		return true;
+
+	/* Precomputation for Miller-Rabin.  */
+	const T nm1 = n - 1;
+
+	/* Find q and k, where q is odd and n = 1 + 2**k * q.  */
 	size_t k = 0;
 	T q = nm1;
 #if HAVE_GMP
@@ -1296,10 +1844,17 @@ bool prime_p(const T &n)
 		q >>= k;
 	}
 
+	/* Keep fixed-width values in Montgomery form across all of the tests.  */
+	const modular<T> mont(n);
+
+	/* Baillie-PSW needs no proof below 2^64.  */
+	if (flag_bpsw or n <= UINT64_MAX)
+		return bpsw(mont);
+
 	T a = 2;
 
 	/* Perform a Miller-Rabin test, finds most composites quickly.  */
-	if (!millerrabin(n, nm1, a, q, k))
+	if (!millerrabin(mont, mont.to(a), q, k))
 		return false;
 
 	if (flag_prove_primality)
@@ -1356,14 +1911,7 @@ bool prime_p(const T &n)
 			is_prime = true;
 			for (const auto &[p, e] : factors)
 			{
-				T tmp = 0;
-#if HAVE_GMP
-				if constexpr (!is_integral_v<T>)
-					mpz_powm(tmp.get_mpz_t(), a.get_mpz_t(), T(nm1 / p).get_mpz_t(), n.get_mpz_t());
-				else
-#endif
-					tmp = powm(a, nm1 / p, n);
-				is_prime = tmp != 1;
+				is_prime = mont.pow(mont.to(a), T(nm1 / p)) != mont.one();
 
 				if (!is_prime)
 					break;
@@ -1380,7 +1928,7 @@ bool prime_p(const T &n)
 
 		a += primes_diff[r]; /* Establish new base.  */
 
-		if (!millerrabin(n, nm1, a, q, k))
+		if (!millerrabin(mont, mont.to(a), q, k))
 			return false;
 	}
 
@@ -1388,38 +1936,52 @@ bool prime_p(const T &n)
 	abort();
 }
 
-template <typename T1, typename T2>
-void factor_using_pollard_rho(T1 &n, size_t a, map<T2, size_t> &factors)
+/* Pollard rho with Brent's cycle detection and the polynomial x^2 + A,
+   starting from A + 1.  Return a nontrivial factor of composite N, or 0 after
+   about BUDGET iterations if it is nonzero or once STOP is set.  When all of
+   the factors are found at once, retry with A + STEP.  */
+template <typename T>
+T factor_using_pollard_rho(const T &n, size_t a, const int_fast64_t budget = 0, const size_t step = 1, const atomic<bool> *stop = nullptr)
 {
-	T1 x = 2, z = 2, y = 2, P = 1;
-	T1 t = 0;
+	/* For fixed-width n, the sequence is computed in Montgomery form.  */
+	[[maybe_unused]] const auto mont = [&]
+	{
+		if constexpr (is_integral_v<T>)
+			return montgomery<T>(n);
+		else
+			return nullptr;
+	}();
 
-	if (dev_debug)
-		cerr << "[pollard-rho (" << a << ")] ";
+	for (;; a += step)
+	{
+		T x = a + 1, z = x, y = x, P = 1;
+		T t = 0;
 
-	int_fast64_t k = 1;
-	int_fast64_t l = 1;
+		if (dev_debug)
+			cerr << "[pollard-rho (" << a << ")] ";
+
+		int_fast64_t k = 1;
+		int_fast64_t l = 1;
 
-	while (n != 1)
-	{
-		// assert(a < n);
 		while (true)
 		{
 			bool factor_found = false;
 			do
 			{
-				if constexpr (!is_integral_v<T1>)
+				if constexpr (!is_integral_v<T>)
 					x = ((x * x) % n) + a;
 				else
-					x = mulm(x, x, n) + a;
+					x = mont.add(mont.mul(x, x), a);
 
-				if constexpr (!is_integral_v<T1>)
+				if constexpr (!is_integral_v<T>)
 					P = (P * (z - x)) % n;
 				else
-					P = mulm(P, diff(z, x), n);
+					P = mont.mul(P, diff(z, x));
 
 				if ((k & 31) == 1)
 				{
+					if (stop and stop->load(memory_order_relaxed))
+						return 0;
 					if (gcd(P, n) != 1)
 					{
 						factor_found = true;
@@ -1435,12 +1997,14 @@ void factor_using_pollard_rho(T1 &n, size_t a, map<T2, size_t> &factors)
 			z = x;
 			k = l;
 			l *= 2;
+			if ((budget and l > budget) or (stop and stop->load(memory_order_relaxed)))
+				return 0;
 			for (int_fast64_t i = 0; i < k; ++i)
 			{
-				if constexpr (!is_integral_v<T1>)
+				if constexpr (!is_integral_v<T>)
 					x = ((x * x) % n) + a;
 				else
-					x = mulm(x, x, n) + a;
+					x = mont.add(mont.mul(x, x), a);
 			}
 
 			y = x;
@@ -1448,300 +2012,3252 @@ void factor_using_pollard_rho(T1 &n, size_t a, map<T2, size_t> &factors)
 
 		do
 		{
-			if constexpr (!is_integral_v<T1>)
+			if constexpr (!is_integral_v<T>)
 				y = ((y * y) % n) + a;
 			else
-				y = mulm(y, y, n) + a;
+				y = mont.add(mont.mul(y, y), a);
 
-			if constexpr (!is_integral_v<T1>)
+			if constexpr (!is_integral_v<T>)
 				t = gcd(z - y, n);
 			else
 				t = gcd(diff(z, y), n);
 		} while (t == 1);
 
-		n /= t; /* divide by t, before t is overwritten */
+		/* Otherwise all of the factors were found at once, so try the next
+		   polynomial.  */
+		if (t != n)
+			return t;
+	}
+}
+
+/* Number of composites being factored at once by factor_queue.  */
+atomic<unsigned> factor_tasks = 0;
+
+/* Number of threads to run, from --threads or the number of cores, shared
+   between the composites being factored at once.  */
+inline unsigned thread_count()
+{
+	const unsigned threads = factor_threads ? factor_threads : max(thread::hardware_concurrency(), 1U);
+	return max(threads / max(factor_tasks.load(), 1U), 1U);
+}
 
-		if (!prime_p(t))
+/* Race Pollard rho on composite N with a different polynomial on each
+   thread, until one of them finds a nontrivial factor.  */
+template <typename T>
+T factor_using_pollard_rho_threads(const T &n)
+{
+	const unsigned threads = thread_count();
+	if (threads == 1)
+		return factor_using_pollard_rho(n, 1);
+
+	atomic<bool> found = false;
+	mutex lock;
+	T factor = 0;
+	const auto race = [&](const unsigned i)
+	{
+		const T g = factor_using_pollard_rho(n, 1 + i, 0, threads, &found);
+		if (g != 0)
 		{
-			if (dev_debug)
-				cerr << "[composite factor--restarting pollard-rho] ";
-			if constexpr (!is_integral_v<T1>)
-			{
-				// t.fits_ulong_p()
-				if (t.fits_slong_p())
-				{
-					unsigned long at = t.get_ui();
-					factor_using_pollard_rho(at, a + 1, factors);
-					t = at;
-				}
-#if HAVE_GMP
-				else if constexpr (INTMAX_MAX > LONG_MAX and t <= INTMAX_MAX)
-				{
-					uintmax_t at = aexport<uintmax_t>(t);
-					factor_using_pollard_rho(at, a + 1, factors);
-					t = import(at);
-				}
-				else if (t <= aINT128_MAX)
-				{
-					auto at = aexport<unsigned __int128>(t);
-					factor_using_pollard_rho(at, a + 1, factors);
-					t = import(at);
-				}
-#endif
-				else
-					factor_using_pollard_rho(t, a + 1, factors);
-			}
-			else if constexpr (is_same_v<T1, unsigned __int128>)
+			const lock_guard<mutex> guard(lock);
+			if (!found)
 			{
-				if (t <= INTMAX_MAX)
-				{
-					uintmax_t at = t;
-					factor_using_pollard_rho(at, a + 1, factors);
-					t = at;
-				}
-				else
-					factor_using_pollard_rho(t, a + 1, factors);
+				factor = g;
+				found = true;
 			}
-			else
-				factor_using_pollard_rho(t, a + 1, factors);
-		}
-		else
-		{
-#if HAVE_GMP
-			if constexpr (!is_integral_v<T2> and is_same_v<T1, unsigned __int128>)
-				++factors[import(t)];
-			else
-#endif
-				++factors[t];
 		}
+	};
 
-		if (prime_p(n))
-		{
-#if HAVE_GMP
-			if constexpr (!is_integral_v<T2> and is_same_v<T1, unsigned __int128>)
-				++factors[import(n)];
-			else
-#endif
-				++factors[n];
-			break;
-		}
+	vector<thread> workers;
+	for (unsigned i = 1; i < threads; ++i)
+		workers.emplace_back(race, i);
+	race(0);
+	for (auto &worker : workers)
+		worker.join();
 
-		x %= n;
-		z %= n;
-		y %= n;
-	}
+	return factor;
 }
 
-/* Use Pollard-rho to compute the prime factors of
-   arbitrary-precision T, and put the results in FACTORS.  */
-template <typename T1, typename T2>
-void factor(T1 &t, map<T2, size_t> &factors)
+/* Square root of N if N is a perfect square, otherwise 0.  N must be below
+   2^52, so that the square root in double precision is exact.  */
+inline uint64_t square_root(const uint64_t n)
 {
-	if (t != 0)
-	{
-		// assert(t >= 2);
-		factor_using_division(t, factors);
+	/* Squares are 0, 1, 4, 9, 16, 17, 25, 33, 36, 41, 49 or 57 modulo 64.  */
+	if (!((0x202021202030213ULL >> (n & 63)) & 1))
+		return 0;
 
-		if (t != 1)
-		{
-			// assert(t >= 2);
-			if (dev_debug)
-				cerr << "[is number prime?] ";
-			if (prime_p(t))
-			{
-#if HAVE_GMP
-				if constexpr (!is_integral_v<T2> and is_same_v<T1, unsigned __int128>)
-					++factors[import(t)];
-				else
-#endif
-					++factors[t];
-			}
-			else
-				factor_using_pollard_rho(t, 1, factors);
-		}
-	}
+	const uint64_t r = sqrt(double(n));
+	return r * r == n ? r : 0;
 }
-#else
-// Execute factor command to get prime factors of number
-template <typename T>
-void factor(const T &number, map<T2<T>, size_t> &counts)
+
+/* Hart's one line factoring algorithm for odd composite N, which is not a
+   perfect square: s^2 mod N is a square t^2 for some s = ceil(sqrt(480 N i)),
+   and then gcd(s - t, N) is a factor.  Return 0 if there is no factor after
+   ITERATIONS values of i, where 480 N ITERATIONS < 2^64.
+   W. B. Hart, A one line factoring algorithm.  */
+uint64_t factor_using_hart(const uint64_t n, const size_t iterations)
 {
-	const string cmd = string(FACTOR) + R"( ")" + tostring(number) + R"(" 2>&1)";
+	if (dev_debug)
+		cerr << "[hart] ";
 
-	string result;
-	if (exec(cmd.c_str(), result))
+	for (uint64_t ni = 480 * n, i = 0; i < iterations; ni += 480 * n, ++i)
 	{
-		cerr << "Error: " << result /*  << "\n" */;
+		uint64_t s = sqrt(double(ni));
+		while (s * s < ni)
+			++s;
+		const uint64_t m = s * s % n;
+		const uint64_t t = m ? square_root(m) : 0;
+		if (m and !t)
+			continue;
+		const uint64_t g = gcd(s - t, n);
+		if (g != 1 and g != n)
+			return g;
 	}
 
-	result = regex_replace(result, re, "");
+	return 0;
+}
 
-	istringstream strm(result);
+/* Shanks' square forms factorization of odd composite N < 2^64 without small
+   factors, for one multiplier K.  The continued fraction expansion of
+   sqrt(K N) runs until a square form, which usually gives a factor of N.
+   https://en.wikipedia.org/wiki/Shanks%27s_square_forms_factorization  */
+class squfof
+{
+	uint64_t n = 0;
+	unsigned __int128 D = 0;
+	uint64_t P0 = 0, P = 0, Pprev = 0, Q = 0, Qprev = 1;
+	size_t i = 2, limit = 0;
 
-	T2<T> temp;
-	if constexpr (is_same_v<T2<T>, unsigned __int128>)
+	/* Run the reverse cycle from the square form Q = r^2 until P repeats.  */
+	uint64_t reverse(const uint64_t r) const
 	{
-		string token;
-		while (strm >> token)
+		uint64_t b = (P0 - P) / r;
+		uint64_t aP = b * r + P;
+		uint64_t aPprev = aP;
+		uint64_t aQprev = r;
+		uint64_t aQ = (D - (unsigned __int128)aP * aP) / r;
+
+		do
 		{
-			temp = strtou128(token.c_str());
-			++counts[temp];
-		}
-	}
-	else
-	{
-		while (strm >> temp)
-			++counts[temp];
+			b = (P0 + aP) / aQ;
+			aPprev = aP;
+			aP = b * aQ - aP;
+			const uint64_t q = aQ;
+			aQ = aQprev + b * (aPprev - aP);
+			aQprev = q;
+		} while (aP != aPprev);
+
+		const uint64_t g = gcd(n, aP);
+		return g != 1 and g != n ? g : 0;
 	}
-}
-#endif
 
-// Output prime factors of number
-template <typename T>
-string outputfactors(const T &number, const bool print_exponents, const bool unicode, const bool all = false)
-{
-	if (number < 1)
+public:
+	squfof(const uint64_t n, const uint64_t k) : n(n), D((unsigned __int128)k * n)
 	{
-		if (all)
-			return "N/A";
-
-		cerr << "Error: Number must be > 0\n";
-		return {};
+		P0 = P = Pprev = isqrt(D);
+		Q = D - (unsigned __int128)P0 * P0;
+		/* About 3 * 2 * sqrt(2 * sqrt(D)) steps, after which a factor is
+		   unlikely.  */
+		limit = 6 * sqrt(2 * sqrt(double(D)));
 	}
 
-	// const T2<T> n = abs(number);
-	T2<T> n = number;
-	// n = number < 0 ? -n : n;
-
-	ostringstream strm;
-	map<T2<T>, size_t> counts;
-	factor(n, counts);
+	/* Whether the expansion ran out of steps without a factor.  */
+	bool exhausted() const { return !Q or i >= limit; }
 
-	for (const auto &[prime, exponent] : counts)
+	/* Run up to STEPS steps of the expansion.  Return a factor, or 0 if there
+	   is none yet.  */
+	uint64_t run(const size_t steps)
 	{
-		for (size_t j = 0; j < exponent; ++j)
+		for (const size_t end = min(i + steps, limit); i < end; ++i)
 		{
-			if (strm.tellp())
-				strm << ' ' << (unicode ? "×" : "*") << ' ';
-			// strm << ' ';
-			if constexpr (is_same_v<T2<T>, unsigned __int128>)
-				strm << outputbase(prime);
-			else
-				strm << prime;
-			if (print_exponents and exponent > 1)
+			const uint64_t b = (P0 + P) / Q;
+			P = b * Q - P;
+			const uint64_t q = Q;
+			Q = Qprev + b * (Pprev - P);
+			if (!(i & 1))
 			{
-				if (unicode)
-					strm << outputexponent(exponent);
-				else
-					strm << '^' << exponent;
-				break;
+				const uint64_t r = square_root(Q);
+				if (r)
+				{
+					const uint64_t g = reverse(r);
+					if (g)
+						return g;
+				}
 			}
+			Qprev = q;
+			Pprev = P;
 		}
+
+		return 0;
 	}
+};
 
-	return strm.str();
-}
+/* Squarefree products of small odd primes to race in SQUFOF, since the
+   expansion for K N can be much shorter than for N.  */
+constexpr unsigned short SQUFOF_MULTIPLIERS[] = {1, 3, 5, 7, 11, 3 * 5, 3 * 7, 3 * 11, 5 * 7, 5 * 11, 7 * 11, 3 * 5 * 7, 3 * 5 * 11, 3 * 7 * 11, 5 * 7 * 11, 3 * 5 * 7 * 11};
 
-// Get divisors of number
-template <typename T>
-vector<T2<T>> divisor(T number)
+/* Race SQUFOF with each multiplier in turn on odd composite N, which is not a
+   perfect square.  Return a factor, or 0 if every multiplier ran out of
+   steps.  */
+uint64_t factor_using_squfof(const uint64_t n)
 {
-	map<T2<T>, size_t> counts;
-	factor(number, counts);
-	vector<T2<T>> divisors{1};
-	divisors.reserve(accumulate(counts.cbegin(), counts.cend(), divisors.size(), [](const size_t sum, const auto &element)
-								{ return sum + (sum * element.second); }));
+	if (dev_debug)
+		cerr << "[squfof] ";
 
-	for (const auto &[prime, exponent] : counts)
+	vector<squfof> races;
+	races.reserve(size(SQUFOF_MULTIPLIERS));
+	for (const unsigned short k : SQUFOF_MULTIPLIERS)
+		races.emplace_back(n, k);
+
+	for (bool running = true; running;)
 	{
-		const size_t count = divisors.size();
-		T2<T> multiplier = 1;
-		for (size_t j = 0; j < exponent; ++j)
+		running = false;
+		for (squfof &race : races)
 		{
-			multiplier *= prime;
-			for (size_t i = 0; i < count; ++i)
-				divisors.push_back(divisors[i] * multiplier);
+			if (race.exhausted())
+				continue;
+			running = true;
+			const uint64_t g = race.run(64);
+			if (g)
+				return g;
 		}
 	}
 
-	divisors.pop_back();
-	sort(divisors.begin(), divisors.end());
-
-	return divisors;
+	return 0;
 }
 
-// Output divisors of number
-template <typename T>
-string outputdivisors(const T &number, const bool all = false)
+/* Call F with each prime P, LO <= P < HI, in increasing order.  The segments
+   are sieved with the primes in primes_diff, so HI must be at most 2^32.  */
+template <typename F>
+void for_each_prime(uint64_t lo, const uint64_t hi, F f)
 {
-	if (number < 1)
+	/* Small ranges come straight from the table.  */
+	if (hi <= FIRST_OMITTED_PRIME)
 	{
-		if (all)
-			return "N/A";
-
-		cerr << "Error: Number must be > 0\n";
-		return {};
+		for (uint64_t p = 2, i = 0; p < hi; p += primes_diff[i], ++i)
+		{
+			if (p >= lo)
+				f(p);
+			if (i == PRIMES_PTAB_ENTRIES)
+				break;
+		}
+		return;
 	}
 
-	ostringstream strm;
-	// const T2<T> n = abs(number);
-	const T2<T> &n = number;
-	// n = number < 0 ? -n : n;
-
-	vector<T2<T>> divisors = divisor(n);
+	if (lo <= 2 and hi > 2)
+		f(2);
+	lo = max<uint64_t>(lo, 3) | 1;
 
-	for (size_t i = 0; i < divisors.size(); ++i)
+	/* Odd numbers in each segment.  */
+	constexpr size_t SEGMENT = 1 << 15;
+	vector<char> composite(SEGMENT);
+	for (uint64_t low = lo; low < hi; low += 2 * SEGMENT)
 	{
-		if (i)
-			strm << ' ';
-		if constexpr (is_same_v<T2<T>, unsigned __int128>)
-			strm << outputbase(divisors[i]);
-		else
-			strm << divisors[i];
-	}
+		const uint64_t high = min(low + 2 * SEGMENT, hi);
+		fill(composite.begin(), composite.end(), false);
+		for (uint64_t p = 3, i = 1; i < PRIMES_PTAB_ENTRIES and p * p < high; p += primes_diff[i], ++i)
+		{
+			uint64_t j = max(p * p, (low + p - 1) / p * p);
+			if (!(j & 1))
+				j += p;
+			for (; j < high; j += 2 * p)
+				composite[(j - low) / 2] = true;
+		}
 
-	return strm.str();
+		for (uint64_t n = low; n < high; n += 2)
+			if (!composite[(n - low) / 2])
+				f(n);
+	}
 }
 
-// Output aliquot sum of number
+/* Pollard's p - 1 method for odd composite N, with stage 1 bound B1 <
+   FIRST_OMITTED_PRIME and stage 2 bound B2 < 2^32.  Find a prime factor p
+   when p - 1 is B1-smooth apart from at most one prime up to B2.  Return 0
+   if there is no factor.
+   https://en.wikipedia.org/wiki/Pollard%27s_p_%E2%88%92_1_algorithm  */
 template <typename T>
-string outputaliquot(const T &number, const bool all = false)
+T factor_using_pm1(const T &n, const uint64_t B1, const uint64_t B2)
 {
-	if (number < 2)
-	{
-		if (all)
-			return "N/A";
+	const modular<T> mont(n);
+	const T one = mont.one();
 
-		cerr << "Error: Number must be > 1\n";
-		return {};
+	if (dev_debug)
+		cerr << "[p-1 B1=" << B1 << " B2=" << B2 << "] ";
+
+	/* Stage 1: x = 2^E, where E is the product of the largest powers of the
+	   primes up to B1.  Collect the powers into words to save calls to pow().  */
+	T x = mont.add(one, one);
+	uint64_t e = 1;
+	for (uint64_t p = 2, i = 0; i < PRIMES_PTAB_ENTRIES and p <= B1; p += primes_diff[i], ++i)
+	{
+		uint64_t q = p;
+		while (q <= B1 / p)
+			q *= p;
+		if (e > UINT64_MAX / q)
+		{
+			x = mont.pow(x, T(e));
+			e = 1;
+		}
+		e *= q;
 	}
+	x = mont.pow(x, T(e));
+
+	T g = gcd(mont.sub(x, one), n);
+	if (g != 1)
+		return g != n ? g : 0;
+
+	/* Stage 2: each prime q = m D - j, with 0 < j < D coprime to D, divides
+	   the order of x modulo p exactly when the giant step x^(m D) and the
+	   baby step x^j are the same modulo p.  */
+	constexpr uint64_t D = 2 * 3 * 5 * 7;
+	vector<T> baby(D);
+	const T x2 = mont.mul(x, x);
+	baby[1] = x;
+	for (size_t j = 3; j < D; j += 2)
+		baby[j] = mont.mul(baby[j - 2], x2);
+
+	const T step = mont.pow(x, T(D));
+	uint64_t m = B1 / D + 1;
+	T giant = mont.pow(step, T(m));
+	T product = one;
+	for_each_prime(B1 + 1, B2 + 1, [&](const uint64_t q)
+				   {
+		for (; m * D < q; ++m)
+			giant = mont.mul(giant, step);
+		product = mont.mul(product, mont.sub(giant, baby[m * D - q])); });
+
+	g = gcd(product, n);
+	return g != 1 and g != n ? g : 0;
+}
 
-	ostringstream strm;
-	// const T2<T> n = abs(number);
-	const T2<T> &n = number;
-	// n = number < 0 ? -n : n;
+/* Montgomery curve B y^2 = x^3 + A x^2 + x, with its points in projective
+   (X : Z) coordinates in the form used by MONT.  (A + 2) / 4 is kept as the
+   fraction A24 / A24D, so no modular inverse is needed.
+   https://eprint.iacr.org/2017/212  */
+template <typename M>
+class montgomery_curve
+{
+	using T = typename M::value_type;
 
-	const vector<T2<T>> divisors = divisor(n);
-	const T2<T> sum = accumulate(divisors.cbegin(), divisors.cend(), T2<T>(0));
+	const M &mont;
+	T a24, a24d;
 
-	if constexpr (is_same_v<T2<T>, unsigned __int128>)
-		strm << outputbase(sum);
-	else
-		strm << sum;
-	strm << " (";
+public:
+	struct point
+	{
+		T X, Z;
+	};
 
-	if (sum == n)
-		strm << "Perfect!";
-	else if (sum < n)
-		strm << "Deficient";
-	else if (sum > n)
-		strm << "Abundant";
+	montgomery_curve(const M &mont, const T &a24, const T &a24d) : mont(mont), a24(a24), a24d(a24d)
+	{
+	}
 
-	strm << ")";
+	/* 2 P  */
+	point dbl(const point &P) const
+	{
+		const T s = mont.add(P.X, P.Z);
+		const T d = mont.sub(P.X, P.Z);
+		const T ss = mont.mul(s, s);
+		const T dd = mont.mul(d, d);
+		/* 4 X Z  */
+		const T t = mont.sub(ss, dd);
+		const T dd24 = mont.mul(dd, a24d);
+		return {mont.mul(ss, dd24), mont.mul(t, mont.add(dd24, mont.mul(a24, t)))};
+	}
+
+	/* P + Q, given their difference D.  */
+	point add(const point &P, const point &Q, const point &D) const
+	{
+		const T u = mont.mul(mont.sub(P.X, P.Z), mont.add(Q.X, Q.Z));
+		const T v = mont.mul(mont.add(P.X, P.Z), mont.sub(Q.X, Q.Z));
+		const T s = mont.add(u, v);
+		const T d = mont.sub(u, v);
+		return {mont.mul(D.Z, mont.mul(s, s)), mont.mul(D.X, mont.mul(d, d))};
+	}
+
+	/* K P for K >= 1, with the Montgomery ladder.  */
+	point mul(const point &P, const uint64_t k) const
+	{
+		point R0 = P;
+		point R1 = dbl(P);
+		for (size_t i = __bit_width(k) - 1; i-- > 0;)
+		{
+			if ((k >> i) & 1)
+			{
+				R0 = add(R1, R0, P);
+				R1 = dbl(R1);
+			}
+			else
+			{
+				R1 = add(R1, R0, P);
+				R0 = dbl(R0);
+			}
+		}
+		return R0;
+	}
+};
+
+/* Run Lenstra's elliptic curve method on one curve, chosen by Suyama's
+   parameter SIGMA, with stage 1 bound B1 and stage 2 bound B2.  Return a
+   factor of the modulus of MONT, or 0 if the curve gives none.
+   https://en.wikipedia.org/wiki/Lenstra_elliptic-curve_factorization  */
+template <typename M>
+typename M::value_type ecm(const M &mont, const uint64_t sigma, const uint64_t B1, const uint64_t B2)
+{
+	using T = typename M::value_type;
+	using point = typename montgomery_curve<M>::point;
+	const T &n = mont.modulus();
+
+	/* Suyama's parameterization, for which 12 divides the group order:
+	   u = sigma^2 - 5, v = 4 sigma, x = u^3 / v^3 and
+	   (A + 2) / 4 = (v - u)^3 (3 u + v) / (16 u^3 v).  */
+	const T s = mont.to(T(sigma));
+	const T u = mont.sub(mont.mul(s, s), mont.to(T(5)));
+	const T v = mont.add(mont.add(s, s), mont.add(s, s));
+	const T u3 = mont.mul(mont.mul(u, u), u);
+	const T vu = mont.sub(v, u);
+	const T a24 = mont.mul(mont.mul(mont.mul(vu, vu), vu), mont.add(mont.add(mont.add(u, u), u), v));
+	T a24d = mont.mul(u3, v);
+	for (size_t i = 0; i < 4; ++i)
+		a24d = mont.add(a24d, a24d);
+	const montgomery_curve<M> curve(mont, a24, a24d);
+	point P{u3, mont.mul(mont.mul(v, v), v)};
+
+	/* Stage 1: multiply by each prime power up to B1.  */
+	for_each_prime(2, B1 + 1, [&](const uint64_t p)
+				   {
+		uint64_t q = p;
+		while (q <= B1 / p)
+			q *= p;
+		P = curve.mul(P, q); });
+
+	/* The Montgomery factor R is a unit, so it does not change the gcd.  */
+	T g = gcd(P.Z, n);
+	if (g != 1)
+		return g != n ? g : 0;
+
+	/* Stage 2: for each prime q = m D ± j up to B2, with baby steps j P and
+	   giant steps m D P, q P is the point at infinity modulo a factor p
+	   exactly when the two steps have the same x-coordinate, so p divides
+	   X_m Z_j - X_j Z_m.  The primes q <= D / 2 are baby steps themselves, so
+	   p divides Z_q.  */
+	constexpr uint64_t D = 2 * 3 * 5 * 7 * 11;
+	vector<point> baby(D / 2 + 1);
+	const point P2 = curve.dbl(P);
+	baby[1] = P;
+	baby[3] = curve.add(P2, P, P);
+	for (size_t j = 5; j <= D / 2; j += 2)
+		baby[j] = curve.add(baby[j - 2], P2, baby[j - 4]);
+
+	const point DP = curve.mul(P, D);
+	uint64_t m = max<uint64_t>((B1 + D / 2) / D, 1);
+	point G = curve.mul(DP, m);
+	point Gnext = curve.mul(DP, m + 1);
+	T product = mont.one();
+	for_each_prime(B1 + 1, B2 + 1, [&](const uint64_t q)
+				   {
+		if (q <= D / 2)
+		{
+			product = mont.mul(product, baby[q].Z);
+			return;
+		}
+		for (; m < (q + D / 2) / D; ++m)
+		{
+			const point next = curve.add(Gnext, DP, G);
+			G = Gnext;
+			Gnext = next;
+		}
+		const point &J = baby[q > m * D ? q - m * D : m * D - q];
+		product = mont.mul(product, mont.sub(mont.mul(G.X, J.Z), mont.mul(J.X, G.Z))); });
+
+	g = gcd(product, n);
+	return g != 1 and g != n ? g : 0;
+}
+
+/* Number of decimal digits of the factors that ECM looks for, B1 and number of
+   curves, from the recommendations of GMP-ECM.  B2 is 100 B1.
+   https://gitlab.inria.fr/zimmerma/ecm  */
+constexpr std::tuple<size_t, uint64_t, size_t> ECM_PARAMETERS[] = {
+	{15, 2000, 25},
+	{20, 11000, 90},
+	{25, 50000, 300},
+	{30, 250000, 700},
+	{35, 1000000, 1800},
+	{40, 3000000, 5100},
+	{45, 11000000, 10600}};
+
+/* Find a factor of composite N with ECM.  Run
+   the curves for each factor size in ECM_PARAMETERS up to the square root of
+   N or MAX_DIGITS, or those set by --ecm-b1, --ecm-b2 and --ecm-curves.
+   Return 0 if no curve gives a factor.  */
+template <typename T>
+T factor_using_ecm(const T &n, const size_t max_digits = SIZE_MAX)
+{
+	const modular<T> mont(n);
+
+	size_t digits = 0;
+#if HAVE_GMP
+	if constexpr (!is_integral_v<T>)
+		digits = mpz_sizeinbase(n.get_mpz_t(), 10);
+	else
+#endif
+		digits = __bit_width(n) * 0.30103 + 1;
+
+	uint64_t sigma = 6;
+	for (const auto &[factor_digits, B1, curves] : ECM_PARAMETERS)
+	{
+		const uint64_t b1 = ecm_b1 ? ecm_b1 : B1;
+		const uint64_t b2 = min(ecm_b2 ? max(ecm_b2, b1) : 100 * b1, ECM_MAX_B2);
+		/* With --ecm-b1 alone, run curves until one finds a factor.  */
+		const size_t count = ecm_curves ? ecm_curves : ecm_b1 ? SIZE_MAX : curves;
+
+		if (dev_debug)
+			cerr << "[ecm B1=" << b1 << " B2=" << b2 << "] ";
+
+		for (size_t i = 0; i < count; ++i, ++sigma)
+		{
+			const T g = ecm(mont, sigma, b1, b2);
+			if (g != 0)
+				return g;
+		}
+
+		if (ecm_b1 or 2 * factor_digits >= digits or factor_digits >= max_digits)
+			break;
+	}
+
+	return 0;
+}
+
+#if HAVE_GMP
+/* Square root of quadratic residue A modulo odd prime P, with the
+   Tonelli-Shanks algorithm.
+   https://en.wikipedia.org/wiki/Tonelli%E2%80%93Shanks_algorithm  */
+uint32_t sqrt_mod(const uint32_t a, const uint32_t p)
+{
+	const auto pow = [p](uint64_t b, uint64_t e)
+	{
+		uint64_t r = 1;
+		for (; e; e >>= 1, b = b * b % p)
+			if (e & 1)
+				r = r * b % p;
+		return r;
+	};
+
+	if (a == 0)
+		return 0;
+	uint32_t q = p - 1;
+	size_t s = __countr_zero(q);
+	q >>= s;
+	uint64_t z = 2;
+	while (pow(z, (p - 1) / 2) != p - 1)
+		++z;
+
+	uint64_t c = pow(z, q);
+	uint64_t x = pow(a, (q + 1) / 2);
+	uint64_t t = pow(a, q);
+	while (t != 1)
+	{
+		size_t i = 0;
+		for (uint64_t t2 = t; t2 != 1; t2 = t2 * t2 % p)
+			++i;
+		uint64_t b = c;
+		for (size_t j = i + 1; j < s; ++j)
+			b = b * b % p;
+		x = x * b % p;
+		c = b * b % p;
+		t = t * c % p;
+		s = i;
+	}
+	return x;
+}
+
+/* Inverse of A modulo P, for A coprime to P.  */
+uint32_t inverse_mod(const uint32_t a, const uint32_t p)
+{
+	int64_t t = 0, nt = 1;
+	uint32_t r = p, nr = a % p;
+	while (nr)
+	{
+		const uint32_t q = r / nr;
+		tie(t, nt) = pair(nt, t - q * nt);
+		tie(r, nr) = pair(nr, r - q * nr);
+	}
+	return t < 0 ? t + p : t;
+}
+
+/* Decimal digits of k N, number of primes in the factor base and half the
+   length of the sieve interval for SIQS.  */
+constexpr std::tuple<size_t, size_t, uint32_t> SIQS_PARAMETERS[] = {
+	{40, 600, 32768},
+	{45, 1000, 32768},
+	{50, 1500, 32768},
+	{55, 2500, 32768},
+	{60, 4000, 32768},
+	{65, 5500, 32768},
+	{70, 8000, 32768},
+	{75, 11000, 65536},
+	{80, 15000, 65536},
+	{85, 20000, 65536},
+	{90, 26000, 98304},
+	{95, 33000, 98304},
+	{100, 40000, 131072}};
+
+/* Self-initializing quadratic sieve.  Each polynomial is
+   g(x) = ((A x + B)^2 - k N) / A, where A is the product of S primes from
+   the factor base and each of the 2^(S-1) values of B is switched to the
+   next by adding or subtracting 2 B_l, so the roots modulo each prime only
+   need an addition.  Sieving finds the x in [-M, M) where g(x) is smooth
+   over the factor base, apart from one large prime.  A set of relations
+   (A x + B)^2 ≡ A g(x) (mod N) whose product is a square, found with
+   Gaussian elimination over GF(2), gives X^2 ≡ Y^2 (mod N), and usually
+   gcd(X - Y, N) is a factor.
+   https://en.wikipedia.org/wiki/Quadratic_sieve
+   https://math.dartmouth.edu/~carlp/implementing.pdf  */
+class siqs
+{
+	/* Y^2 ≡ -1^e0 p1^e1 ... LARGE^2 (mod N), where FACTORS has the index
+	   of each prime in the factor base once for each power and 0 for -1.  */
+	struct relation
+	{
+		mpz_class y;
+		vector<uint32_t> factors;
+		uint64_t large;
+	};
+
+	const mpz_class &n;
+	mpz_class kn;
+	/* The factor base, which starts with a placeholder for -1 and then 2,
+	   and the square roots of k N modulo each prime.  */
+	vector<uint32_t> primes, roots;
+	vector<unsigned char> logs;
+	uint32_t interval;
+	/* Index of the first prime which is sieved.  The smaller ones are only
+	   used for trial division.  */
+	size_t first;
+	/* Range of the factor base to pick the S primes of A from.  */
+	size_t lo, hi, s;
+	mpz_class target;
+	unsigned char init;
+	uint64_t large_bound;
+
+	mutex lock;
+	atomic<bool> done{false};
+	size_t needed;
+	vector<relation> relations;
+	map<uint64_t, relation> partials;
+	vector<mpz_class> used;
+
+	static uint32_t multiplier(const mpz_class &n);
+	void choose_a(uint64_t &state, mpz_class &a, vector<size_t> &indices);
+
+public:
+	explicit siqs(const mpz_class &n);
+	void sieve(uint64_t seed);
+	mpz_class solve();
+
+	/* Ask for more relations, after every dependency gave a trivial factor.  */
+	void more()
+	{
+		needed += primes.size() / 20 + 16;
+		done = false;
+	}
+};
+
+/* The Knuth-Schroeppel multiplier k, which makes the small primes divide the
+   values of the polynomials often.  */
+uint32_t siqs::multiplier(const mpz_class &n)
+{
+	constexpr uint32_t MULTIPLIERS[] = {1, 3, 5, 7, 11, 13, 15, 17, 19, 21, 23, 29, 31, 33, 35, 37, 39, 41, 43, 47, 51, 53, 55, 57, 59, 61, 65, 67, 69, 71, 73};
+
+	uint32_t best = 1;
+	double best_score = -numeric_limits<double>::infinity();
+	for (const uint32_t k : MULTIPLIERS)
+	{
+		const unsigned long kn8 = mpz_fdiv_ui(n.get_mpz_t(), 8) * k % 8;
+		double score = -0.5 * log(k);
+		if (kn8 == 1)
+			score += 2 * log(2);
+		else if (kn8 == 5)
+			score += log(2);
+		else if (kn8 == 3 or kn8 == 7)
+			score += 0.5 * log(2);
+
+		for (uint64_t p = 3, i = 1; p < 1000; p += primes_diff[i], ++i)
+		{
+			const unsigned long r = mpz_fdiv_ui(n.get_mpz_t(), p) * k % p;
+			if (r == 0)
+				score += log(p) / p;
+			else if (jacobi<uint64_t>(r, p) == 1)
+				score += 2 * log(p) / (p - 1);
+		}
+
+		if (score > best_score)
+		{
+			best_score = score;
+			best = k;
+		}
+	}
+
+	return best;
+}
+
+siqs::siqs(const mpz_class &n) : n(n)
+{
+	const uint32_t k = multiplier(n);
+	kn = n * k;
+	const size_t digits = mpz_sizeinbase(kn.get_mpz_t(), 10);
+
+	size_t size = 0;
+	for (const auto &[max_digits, fb, m] : SIQS_PARAMETERS)
+	{
+		size = fb;
+		interval = m;
+		if (digits <= max_digits)
+			break;
+	}
+
+	/* About half of the primes have k N as a quadratic residue.  */
+	const double x = 2.0 * size;
+	primes = {1, 2};
+	roots = {0, mpz_odd_p(kn.get_mpz_t()) != 0};
+	for_each_prime(3, x * (log(x) + log(log(x))) * 1.5 + 100, [&](const uint64_t p)
+				   {
+		if (primes.size() == size)
+			return;
+		const uint32_t r = mpz_fdiv_ui(kn.get_mpz_t(), p);
+		if (r == 0 or jacobi<uint64_t>(r, p) == 1)
+		{
+			primes.push_back(p);
+			roots.push_back(sqrt_mod(r, p));
+		} });
+	const uint32_t pmax = primes.back();
+
+	first = 1;
+	while (first < primes.size() and primes[first] < 30)
+		++first;
+	large_bound = uint64_t(pmax) * min<uint32_t>(pmax, 64);
+
+	/* The values of g(x) are at most about M sqrt(k N / 2).  The threshold
+	   leaves room for a large prime, the primes which are not sieved and
+	   prime powers, with the 13 bits found by experiment.  Scale the
+	   logarithms to leave room in a byte and start each sieve location at
+	   128 less the threshold, so the candidates have the top bit set.  */
+	const double bits = log2(interval) + (mpz_sizeinbase(kn.get_mpz_t(), 2) - 1) / 2.0;
+	const double scale = 100 / bits;
+	logs.resize(primes.size());
+	for (size_t i = 1; i < primes.size(); ++i)
+		logs[i] = lround(log2(primes[i]) * scale);
+	init = 128 - lround((bits - log2(large_bound) - 13) * scale);
+
+	/* The primes of A are chosen near the S-th root of sqrt(2 k N) / M.  */
+	target = sqrt(2 * kn) / interval;
+	const double target_bits = mpz_sizeinbase(target.get_mpz_t(), 2);
+	s = max<size_t>(lround(target_bits / log2(2000)), 3);
+	const uint32_t q = exp2(target_bits / s);
+	lo = lower_bound(primes.begin() + first, primes.end(), q / 2) - primes.begin();
+	hi = upper_bound(primes.begin() + first, primes.end(), q * 2) - primes.begin();
+	lo = min(lo, primes.size() / 2);
+	hi = min(max(hi, lo + 4 * s), primes.size());
+
+	needed = primes.size() + 64;
+	relations.reserve(needed);
+
+	if (dev_debug)
+		cerr << "[siqs k=" << k << " primes=" << primes.size() << " pmax=" << pmax << " M=" << interval << " s=" << s << "] ";
+}
+
+/* Pick a new A near TARGET from the primes between LO and HI, with the last
+   one chosen to get closest.  */
+void siqs::choose_a(uint64_t &state, mpz_class &a, vector<size_t> &indices)
+{
+	const auto random = [&state]()
+	{
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+		return state;
+	};
+
+	for (;;)
+	{
+		indices.clear();
+		a = 1;
+		while (indices.size() < s - 1)
+		{
+			const size_t i = lo + random() % (hi - lo);
+			if (roots[i] != 0 and find(indices.begin(), indices.end(), i) == indices.end())
+			{
+				indices.push_back(i);
+				a *= primes[i];
+			}
+		}
+
+		const mpz_class rest = target / a;
+		if (!rest.fits_uint_p())
+			continue;
+		size_t i = lower_bound(primes.begin() + first, primes.end(), rest.get_ui()) - primes.begin();
+		while (i < primes.size() and (roots[i] == 0 or find(indices.begin(), indices.end(), i) != indices.end()))
+			++i;
+		if (i == primes.size())
+			continue;
+		indices.push_back(i);
+		a *= primes[i];
+
+		const lock_guard guard(lock);
+		if (find(used.begin(), used.end(), a) == used.end())
+		{
+			used.push_back(a);
+			return;
+		}
+	}
+}
+
+/* Sieve with new polynomials until there are enough relations.  */
+void siqs::sieve(uint64_t seed)
+{
+	const size_t size = primes.size();
+	const size_t span = 2 * size_t(interval);
+	vector<unsigned char> sieve(span + 8);
+	vector<uint32_t> root1(size), root2(size);
+	vector<vector<uint32_t>> deltas(s, vector<uint32_t>(size));
+	vector<size_t> indices;
+	vector<mpz_class> terms(s);
+	vector<int> signs(s);
+	mpz_class a, b, c, g, y;
+	vector<relation> found;
+	constexpr uint32_t SKIP = UINT32_MAX;
+	seed = seed * 0x9E3779B97F4A7C15 + 1;
+
+	while (!done)
+	{
+		choose_a(seed, a, indices);
+
+		/* B_l = (A / q_l) (t_l (A / q_l)^-1 mod q_l), so B^2 ≡ k N (mod A)
+		   for each B = ±B_1 ± ... ± B_S.  */
+		b = 0;
+		for (size_t l = 0; l < s; ++l)
+		{
+			const uint32_t q = primes[indices[l]];
+			const mpz_class aq = a / q;
+			uint64_t gamma = uint64_t(roots[indices[l]]) * inverse_mod(mpz_fdiv_ui(aq.get_mpz_t(), q), q) % q;
+			if (gamma > q / 2)
+				gamma = q - gamma;
+			terms[l] = aq * gamma;
+			b += terms[l];
+			signs[l] = 1;
+		}
+
+		/* The roots x ≡ A^-1 (±t - B) (mod p), offset by M.  */
+		for (size_t j = 1; j < size; ++j)
+		{
+			const uint32_t p = primes[j];
+			if (p == 2 or find(indices.begin(), indices.end(), j) != indices.end())
+			{
+				root1[j] = root2[j] = SKIP;
+				continue;
+			}
+			const uint64_t ainv = inverse_mod(mpz_fdiv_ui(a.get_mpz_t(), p), p);
+			const uint64_t bp = mpz_fdiv_ui(b.get_mpz_t(), p);
+			const uint64_t t = roots[j];
+			const uint64_t m = interval % p;
+			root1[j] = (ainv * (t + p - bp) + m) % p;
+			root2[j] = (ainv * (2 * p - t - bp) + m) % p;
+			for (size_t l = 0; l < s; ++l)
+				deltas[l][j] = 2 * ainv * mpz_fdiv_ui(terms[l].get_mpz_t(), p) % p;
+		}
+
+		for (size_t i = 0;; ++i)
+		{
+			c = (b * b - kn) / a;
+
+			fill(sieve.begin(), sieve.end(), init);
+			fill(sieve.begin() + span, sieve.end(), 0);
+			for (size_t j = first; j < size; ++j)
+			{
+				if (root1[j] == SKIP)
+					continue;
+				const uint32_t p = primes[j];
+				const unsigned char lp = logs[j];
+				for (size_t k = root1[j]; k < span; k += p)
+					sieve[k] += lp;
+				if (root2[j] != root1[j])
+					for (size_t k = root2[j]; k < span; k += p)
+						sieve[k] += lp;
+			}
+
+			for (size_t w = 0; w < span; w += 8)
+			{
+				uint64_t word;
+				memcpy(&word, &sieve[w], sizeof(word));
+				if (!(word & 0x8080808080808080))
+					continue;
+
+				for (size_t k = w; k < w + 8; ++k)
+				{
+					if (!(sieve[k] & 0x80))
+						continue;
+
+					/* A g(x) = (A x + B)^2 - k N, with g(x) = (A x + 2 B) x + C.  */
+					const long x = long(k) - long(interval);
+					g = a * x + 2 * b;
+					g = g * x + c;
+					relation rel{a * x + b, {}, 1};
+					if (g < 0)
+					{
+						rel.factors.push_back(0);
+						g = -g;
+					}
+					rel.factors.insert(rel.factors.end(), indices.begin(), indices.end());
+					for (size_t j = 1; j < size; ++j)
+					{
+						const uint32_t p = primes[j];
+						if (root1[j] != SKIP)
+						{
+							const uint32_t r = k % p;
+							if (r != root1[j] and r != root2[j])
+								continue;
+						}
+						while (mpz_divisible_ui_p(g.get_mpz_t(), p))
+						{
+							mpz_divexact_ui(g.get_mpz_t(), g.get_mpz_t(), p);
+							rel.factors.push_back(j);
+						}
+					}
+
+					if (g == 1 or (g.fits_ulong_p() and g.get_ui() < large_bound))
+					{
+						rel.large = g.get_ui();
+						found.push_back(move(rel));
+					}
+				}
+			}
+
+			if (i + 1 == size_t(1) << (s - 1) or done)
+				break;
+
+			/* Gray code: flip the sign of B_v, with v the lowest set bit of
+			   i + 1, and move the roots by 2 B_v A^-1 (mod p).  */
+			const size_t v = __countr_zero(i + 1);
+			if (signs[v] > 0)
+				b -= 2 * terms[v];
+			else
+				b += 2 * terms[v];
+			for (size_t j = 1; j < size; ++j)
+			{
+				if (root1[j] == SKIP)
+					continue;
+				const uint32_t p = primes[j];
+				const uint32_t d = signs[v] > 0 ? deltas[v][j] : p - deltas[v][j];
+				root1[j] = root1[j] + d >= p ? root1[j] + d - p : root1[j] + d;
+				root2[j] = root2[j] + d >= p ? root2[j] + d - p : root2[j] + d;
+			}
+			signs[v] = -signs[v];
+		}
+
+		const lock_guard guard(lock);
+		for (auto &rel : found)
+		{
+			if (rel.large == 1)
+				relations.push_back(move(rel));
+			else
+			{
+				/* Two partial relations with the same large prime make a full one.  */
+				const auto [it, inserted] = partials.try_emplace(rel.large, rel);
+				if (!inserted and it->second.y != rel.y)
+				{
+					rel.y = rel.y * it->second.y % n;
+					rel.factors.insert(rel.factors.end(), it->second.factors.begin(), it->second.factors.end());
+					relations.push_back(move(rel));
+				}
+			}
+		}
+		found.clear();
+		if (relations.size() >= needed)
+			done = true;
+	}
+}
+
+/* Find the dependencies between the relations with Gaussian elimination over
+   GF(2), with the method of Koç and Arachchige, and try each of them.  Return
+   a factor of N, or 0 if they all give a trivial one.
+   https://doi.org/10.1016/0743-7315(91)90120-P  */
+mpz_class siqs::solve()
+{
+	const size_t size = primes.size();
+	const size_t count = relations.size();
+	const size_t words = (count + 63) / 64;
+
+	/* One row for each prime, with a bit for each relation where it has an
+	   odd exponent.  */
+	vector<vector<uint64_t>> matrix(size, vector<uint64_t>(words));
+	for (size_t r = 0; r < count; ++r)
+		for (const uint32_t j : relations[r].factors)
+			matrix[j][r / 64] ^= uint64_t(1) << (r % 64);
+
+	vector<size_t> pivots(size, SIZE_MAX);
+	vector<char> marked(count);
+	for (size_t j = 0; j < size; ++j)
+	{
+		const vector<uint64_t> &row = matrix[j];
+		size_t w = 0;
+		while (w < words and !row[w])
+			++w;
+		if (w == words)
+			continue;
+		const size_t r = 64 * w + __countr_zero(row[w]);
+		pivots[j] = r;
+		marked[r] = true;
+		for (size_t i = 0; i < size; ++i)
+			if (i != j and ((matrix[i][w] >> (r % 64)) & 1))
+				for (size_t l = w; l < words; ++l)
+					matrix[i][l] ^= row[l];
+	}
+
+	/* Each unmarked relation, with the pivots of the rows where it is set,
+	   has a product which is a square.  */
+	vector<size_t> exponents(size);
+	mpz_class x, y, g;
+	for (size_t r = 0; r < count; ++r)
+	{
+		if (marked[r])
+			continue;
+
+		vector<size_t> dependency = {r};
+		for (size_t j = 0; j < size; ++j)
+			if (pivots[j] != SIZE_MAX and ((matrix[j][r / 64] >> (r % 64)) & 1))
+				dependency.push_back(pivots[j]);
+
+		fill(exponents.begin(), exponents.end(), 0);
+		x = 1;
+		y = 1;
+		for (const size_t i : dependency)
+		{
+			x = x * relations[i].y % n;
+			y = y * relations[i].large % n;
+			for (const uint32_t j : relations[i].factors)
+				++exponents[j];
+		}
+		for (size_t j = 1; j < size; ++j)
+		{
+			if (exponents[j])
+			{
+				mpz_class power;
+				mpz_powm_ui(power.get_mpz_t(), mpz_class(primes[j]).get_mpz_t(), exponents[j] / 2, n.get_mpz_t());
+				y = y * power % n;
+			}
+		}
+
+		g = gcd(mpz_class(x - y), n);
+		if (g != 1 and g != n)
+			return g;
+	}
+
+	return 0;
+}
+
+/* Find a factor of composite N, which is not a perfect power, with the
+   self-initializing quadratic sieve, sieving on every core.  The square roots
+   of 1 modulo a prime power are only ±1, so it would never find one.  */
+mpz_class factor_using_siqs(const mpz_class &n)
+{
+	siqs qs(n);
+	const unsigned threads = thread_count();
+	for (;;)
+	{
+		vector<thread> workers;
+		for (unsigned i = 1; i < threads; ++i)
+			workers.emplace_back(&siqs::sieve, &qs, i);
+		qs.sieve(0);
+		for (auto &worker : workers)
+			worker.join();
+
+		const mpz_class g = qs.solve();
+		if (g != 0)
+			return g;
+		qs.more();
+	}
+}
+#endif
+
+/* Methods for splitting a composite, in the order they usually run.  */
+enum factor_method
+{
+	method_none,
+	method_hart,
+	method_squfof,
+	method_pm1,
+	method_rho,
+	method_rho_threads,
+	method_ecm,
+	method_siqs,
+	method_count
+};
+
+/* A stage of a factoring plan.  The budget is the number of iterations for
+   Hart's algorithm and rho, B1 for p - 1, where B2 is 50 B1, and the largest
+   factors ECM looks for, in percent of the digits of the composite.  0 is no
+   limit.  */
+struct factor_stage
+{
+	factor_method method;
+	uint64_t budget;
+};
+
+/* The stages factor_cofactor() runs on composites up to each number of bits,
+   until one splits it.  Rho in Montgomery form is faster on average than
+   SQUFOF from about 40 bits, so SQUFOF only catches the few numbers for which
+   Hart's algorithm runs out of iterations, and 480 N 2^15 < 2^64.  p - 1
+   quickly finds the factors p where p - 1 is smooth, rho the small ones and
+   ECM the larger ones.  SIQS takes about the same time whatever the size of
+   the factors, so ECM only looks for those up to about a quarter of the
+   digits first.  */
+constexpr struct
+{
+	size_t bits;
+	factor_stage stages[6];
+} FACTOR_PLANS[] = {
+	{40, {{method_hart, 1 << 15}, {method_squfof, 0}, {method_rho, 0}}},
+	{64, {{method_pm1, 500}, {method_rho, 0}}},
+	{128, {{method_pm1, 5000}, {method_rho, 1 << 16}, {method_ecm, 50}, {method_rho_threads, 0}}},
+	{SIZE_MAX, {{method_pm1, 50000}, {method_rho, 1 << 16}, {method_ecm, 25}, {method_siqs, 0}, {method_rho_threads, 0}}}};
+
+/* Largest budget each method has already failed with on a composite, which
+   the stages for its factors can skip.  */
+using factor_work = array<uint64_t, method_count>;
+
+/* Run one stage of a plan on composite N, with BUDGET already converted to
+   its units.  Return a nontrivial factor, or 0 if it gives none.  */
+template <typename T>
+T factor_using(const T &n, const factor_method method, const uint64_t budget)
+{
+	switch (method)
+	{
+	case method_hart:
+		if constexpr (is_integral_v<T>)
+			return factor_using_hart(n, budget);
+		break;
+	case method_squfof:
+		if constexpr (is_integral_v<T>)
+			return factor_using_squfof(n);
+		break;
+	case method_pm1:
+		return factor_using_pm1(n, budget, 50 * budget);
+	case method_rho:
+		return factor_using_pollard_rho(n, 1, budget);
+	case method_rho_threads:
+		return factor_using_pollard_rho_threads(n);
+	case method_ecm:
+		return factor_using_ecm(n, budget);
+	case method_siqs:
+#if HAVE_GMP
+		if constexpr (!is_integral_v<T>)
+			return factor_using_siqs(n);
+#endif
+		break;
+	default:
+		break;
+	}
+	return 0;
+}
+
+template <typename T2>
+class factor_queue;
+
+template <typename T1, typename T2>
+void factor_cofactor(T1 &t, factor_queue<T2> &queue, factor_work spent, size_t exponent);
+
+/* Number of bits in N.  */
+template <typename T>
+size_t bit_length(const T &n)
+{
+#if HAVE_GMP
+	if constexpr (!is_integral_v<T>)
+		return mpz_sizeinbase(n.get_mpz_t(), 2);
+	else
+#endif
+		return __bit_width(n);
+}
+
+/* If N = m^k for the largest such k, replace N with m and return k.  The
+   prime factors of N must be above the trial division bound, so k is at most
+   log2(N) / 16.  Rho on a perfect power would find the same prime many
+   times.  */
+template <typename T>
+size_t perfect_power(T &n)
+{
+#if HAVE_GMP
+	if constexpr (!is_integral_v<T>)
+	{
+		if (!mpz_perfect_power_p(n.get_mpz_t()))
+			return 1;
+	}
+#endif
+
+	/* If N is an m^k, but not a j-th power for any prime j < k, neither is m,
+	   so each prime only needs to be tried once.  */
+	size_t exponent = 1;
+	for (size_t k = 2, i = 0; 16 * k < bit_length(n); k += primes_diff[i], ++i)
+	{
+		for (;;)
+		{
+			T root;
+#if HAVE_GMP
+			if constexpr (!is_integral_v<T>)
+			{
+				if (!mpz_root(root.get_mpz_t(), n.get_mpz_t(), k))
+					break;
+			}
+			else
+#endif
+			{
+				root = iroot(n, k);
+				T power = root;
+				for (size_t j = 1; j < k; ++j)
+					power *= root;
+				if (power != n)
+					break;
+			}
+			n = root;
+			exponent *= k;
+		}
+	}
+
+	return exponent;
+}
+
+/* Queue of composites to factor, which starts another thread whenever one
+   of them queues another and no thread is idle, up to --threads, and collects
+   their prime factors.  */
+template <typename T2>
+class factor_queue
+{
+	map<T2, size_t> &factors;
+	mutex lock;
+	condition_variable ready;
+	vector<function<void()>> tasks;
+	vector<thread> workers;
+	size_t idle = 0;
+	size_t running = 0;
+
+	/* Run the tasks until there are none left on any thread.  */
+	void work()
+	{
+		unique_lock<mutex> guard(lock);
+		for (;;)
+		{
+			if (!tasks.empty())
+			{
+				const function<void()> task = move(tasks.back());
+				tasks.pop_back();
+				++running;
+				guard.unlock();
+				++factor_tasks;
+				task();
+				--factor_tasks;
+				guard.lock();
+				--running;
+			}
+			else if (!running)
+			{
+				ready.notify_all();
+				return;
+			}
+			else
+			{
+				++idle;
+				ready.wait(guard);
+				--idle;
+			}
+		}
+	}
+
+public:
+	explicit factor_queue(map<T2, size_t> &afactors) : factors(afactors) {}
+
+	/* Add prime P to the factors EXPONENT times.  */
+	template <typename T1>
+	void add(const T1 &p, const size_t exponent)
+	{
+		const lock_guard<mutex> guard(lock);
+#if HAVE_GMP
+		if constexpr (!is_integral_v<T2> and is_same_v<T1, unsigned __int128>)
+			factors[import(p)] += exponent;
+		else
+#endif
+			factors[p] += exponent;
+	}
+
+	/* Queue composite T^EXPONENT, skipping the methods in SPENT.  */
+	template <typename T1>
+	void push(const T1 &t, const factor_work &spent, const size_t exponent)
+	{
+		const lock_guard<mutex> guard(lock);
+		tasks.emplace_back([this, at = t, spent, exponent]() mutable
+						   { factor_cofactor(at, *this, spent, exponent); });
+		if (idle)
+			ready.notify_one();
+		else if (running and workers.size() + 1 < thread_count())
+			workers.emplace_back(&factor_queue::work, this);
+	}
+
+	/* Put the prime factors of composite T into the factors.  */
+	template <typename T1>
+	void run(const T1 &t)
+	{
+		push(t, {}, 1);
+		work();
+		for (auto &worker : workers)
+			worker.join();
+	}
+};
+
+/* Put the prime factors of composite T^EXPONENT into QUEUE, with the plan in
+   FACTOR_PLANS for the size of T, skipping the methods which already failed
+   with at least the same budget on a multiple of it, in SPENT.  When it
+   splits into two composites, queue one of them for another thread.  */
+template <typename T1, typename T2>
+void factor_cofactor(T1 &t, factor_queue<T2> &queue, factor_work spent, size_t exponent)
+{
+	/* Use the narrowest type which fits.  */
+	if (narrow(t, [&](auto at)
+			   { factor_cofactor(at, queue, spent, exponent); }))
+	{
+		t = 1;
+		return;
+	}
+
+	if (const size_t k = perfect_power(t); k > 1)
+	{
+		if (prime_p(t))
+			queue.add(t, exponent * k);
+		else
+			factor_cofactor(t, queue, spent, exponent * k);
+		t = 1;
+		return;
+	}
+
+	size_t bits = 0, digits = 0;
+#if HAVE_GMP
+	if constexpr (!is_integral_v<T1>)
+	{
+		bits = mpz_sizeinbase(t.get_mpz_t(), 2);
+		digits = mpz_sizeinbase(t.get_mpz_t(), 10);
+	}
+	else
+#endif
+	{
+		bits = __bit_width(t);
+		digits = bits * 0.30103 + 1;
+	}
+
+	const auto &plan = *find_if(begin(FACTOR_PLANS), end(FACTOR_PLANS), [&](const auto &aplan)
+								{ return bits <= aplan.bits; });
+	for (const auto &[method, budget] : plan.stages)
+	{
+		if (method == method_none)
+			break;
+		const uint64_t work = method == method_ecm ? digits * budget / 100 : budget;
+		if (work and spent[method] >= work)
+			continue;
+
+		const T1 g = factor_using(t, method, work);
+		if (g != 0)
+		{
+			T1 f = t / g;
+			const bool g_prime = prime_p(g), f_prime = prime_p(f);
+			if (g_prime)
+				queue.add(g, exponent);
+			if (f_prime)
+				queue.add(f, exponent);
+			if (!g_prime and !f_prime)
+				queue.push(g, spent, exponent);
+			else if (!g_prime)
+				f = g;
+			if (!g_prime or !f_prime)
+				factor_cofactor(f, queue, spent, exponent);
+			t = 1;
+			return;
+		}
+		if (work)
+			spent[method] = max(spent[method], work);
+	}
+
+	cerr << "Factoring plan failure.  This should not happen\n";
+	abort();
+}
+
+#ifdef FACTOR
+/* The factor command, started once and kept running.  It reads the numbers
+   from a socket and writes its output and errors to a pseudoterminal, so that
+   it outputs each line as soon as it is done instead of buffering them, as it
+   would on a pipe.  */
+class factor_coprocess
+{
+	mutex lock;
+	pid_t pid = -1;
+	int input = -1;
+	int output = -1;
+	string buffer;
+	/* Whether the command ever output the factors of a number, or failed
+	   before it did.  */
+	bool worked = false;
+	bool failed = false;
+
+	bool start()
+	{
+		int fds[2];
+		if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds))
+			return false;
+		input = fds[0];
+
+		output = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+		if (output < 0 or grantpt(output) or unlockpt(output))
+		{
+			close(fds[1]);
+			return false;
+		}
+		const int terminal = open(ptsname(output), O_RDWR | O_NOCTTY | O_CLOEXEC);
+		if (terminal < 0)
+		{
+			close(fds[1]);
+			return false;
+		}
+		/* No echo and no CR before each LF.  */
+		termios attributes;
+		tcgetattr(terminal, &attributes);
+		cfmakeraw(&attributes);
+		tcsetattr(terminal, TCSANOW, &attributes);
+
+		pid = fork();
+		if (!pid)
+		{
+			dup2(fds[1], STDIN_FILENO);
+			dup2(terminal, STDOUT_FILENO);
+			dup2(terminal, STDERR_FILENO);
+			execl("/bin/sh", "sh", "-c", "exec " FACTOR, nullptr);
+			_exit(127);
+		}
+		close(fds[1]);
+		close(terminal);
+		return pid > 0;
+	}
+
+	void stop()
+	{
+		if (input >= 0)
+			close(input);
+		if (output >= 0)
+			close(output);
+		if (pid > 0)
+			waitpid(pid, nullptr, 0);
+		pid = input = output = -1;
+		buffer.clear();
+	}
+
+public:
+	~factor_coprocess()
+	{
+		stop();
+	}
+
+	/* Write NUMBER and read its line of output into LINE.  If the command
+	   exits first, put any other output into LINE, return false and start it
+	   again on the next call, unless it never worked (see succeeded()).  */
+	bool factor(const string &number, string &line)
+	{
+		const lock_guard<mutex> guard(lock);
+		if (failed or (pid < 0 and !start()))
+		{
+			stop();
+			failed = true;
+			line = "Could not run the " FACTOR " command";
+			return false;
+		}
+
+		const string text = number + '\n';
+		for (size_t i = 0; i < text.size();)
+		{
+			const ssize_t n = send(input, text.data() + i, text.size() - i, MSG_NOSIGNAL);
+			if (n < 0 and errno != EINTR)
+				break;
+			if (n > 0)
+				i += n;
+		}
+
+		size_t end;
+		while ((end = buffer.find('\n')) == string::npos)
+		{
+			char chunk[4096];
+			const ssize_t n = read(output, chunk, sizeof(chunk));
+			if (n < 0 and errno == EINTR)
+				continue;
+			/* Reading the pseudoterminal fails with EIO once the command
+			   exits.  */
+			if (n <= 0)
+			{
+				line = buffer.empty() ? "The " FACTOR " command exited" : buffer;
+				stop();
+				failed = !worked;
+				return false;
+			}
+			buffer.append(chunk, n);
+		}
+
+		line.assign(buffer, 0, end);
+		buffer.erase(0, end + 1);
+		return true;
+	}
+
+	/* Record that a line was the factors of its number, and not an error
+	   message such as from the shell if the command is not found.  */
+	void succeeded()
+	{
+		const lock_guard<mutex> guard(lock);
+		worked = true;
+	}
+};
+
+factor_coprocess coprocess;
+
+/* Put the prime factors of T into FACTORS with the factor command.  Return
+   false with the error message in ERROR if it fails.  */
+template <typename T1, typename T2>
+bool factor_external(const T1 &t, map<T2, size_t> &factors, string &error)
+{
+	const string text = tostring(t);
+
+	string line;
+	const bool ok = coprocess.factor(text, line);
+	/* The output is the number, a colon and the factors separated by
+	   spaces.  Anything else is an error message.  */
+	if (!ok or line.compare(0, text.size(), text) or line[text.size()] != ':')
+	{
+		error = line;
+		return false;
+	}
+	coprocess.succeeded();
+
+	for (const char *p = line.c_str() + text.size() + 1, *const end = line.c_str() + line.size(); p < end;)
+	{
+		if (*p == ' ')
+		{
+			++p;
+			continue;
+		}
+
+		const char *const next = find(p, end, ' ');
+		T2 temp = 0;
+		if constexpr (is_same_v<T2, unsigned __int128>)
+			temp = strtou128(p);
+		else if constexpr (is_integral_v<T2>)
+			from_chars(p, next, temp);
+		else
+			temp.set_str(string(p, next), 10);
+		++factors[temp];
+		p = next;
+	}
+	return true;
+}
+#endif
+
+/* Use Pollard-rho to compute the prime factors of
+   arbitrary-precision T, and put the results in FACTORS.  */
+template <typename T1, typename T2>
+void factor(T1 &t, map<T2, size_t> &factors)
+{
+#ifdef FACTOR
+	if (backend == backend_external)
+	{
+		string error;
+		if (t != 0 and !factor_external(t, factors, error))
+			cerr << "Error: " << error << '\n';
+		return;
+	}
+#endif
+
+	if (t != 0)
+	{
+		// assert(t >= 2);
+		factor_using_division(t, factors);
+
+		if (t != 1)
+		{
+			// assert(t >= 2);
+			if (dev_debug)
+				cerr << "[is number prime?] ";
+			if (prime_p(t))
+			{
+#if HAVE_GMP
+				if constexpr (!is_integral_v<T2> and is_same_v<T1, unsigned __int128>)
+					++factors[import(t)];
+				else
+#endif
+					++factors[t];
+			}
+			else
+			{
+#ifdef FACTOR
+				/* Fall back to the builtin prime factorization if the command
+				   fails.  */
+				string error;
+				if (backend == backend_auto and bit_length(t) >= factor_threshold)
+				{
+					if (factor_external(t, factors, error))
+					{
+						t = 1;
+						return;
+					}
+					if (dev_debug)
+						cerr << "[" << error << "] ";
+				}
+#endif
+				factor_queue<T2> queue(factors);
+				queue.run(t);
+				t = 1;
+			}
+		}
+	}
+}
+
+#ifdef FACTOR
+/* Time the builtin prime factorization and the factor command on products of
+   two random primes of the same size, for increasing sizes until either takes
+   over a second, and output the number of bits from which the command is
+   faster.  */
+int calibrate()
+{
+	const factor_backend abackend = backend;
+	backend = backend_builtin;
+
+	mt19937_64 engine;
+	const auto random_prime = [&](const size_t bits)
+	{
+		unsigned __int128 p = (unsigned __int128)engine() << 64 | engine();
+		p = p >> (128 - bits) | (unsigned __int128)1 << (bits - 1) | 1;
+		while (!prime_p(p))
+			p += 2;
+		return p;
+	};
+
+	constexpr size_t COUNT = 5;
+	size_t threshold = 0;
+	for (size_t bits = 32; bits <= 124; bits += 4)
+	{
+		vector<unsigned __int128> numbers(COUNT);
+		for (auto &n : numbers)
+			n = random_prime(bits / 2) * random_prime(bits - bits / 2);
+
+		map<unsigned __int128, size_t> factors;
+		auto start = chrono::steady_clock::now();
+		for (unsigned __int128 n : numbers)
+			factor(n, factors);
+		const chrono::duration<double> builtin = chrono::steady_clock::now() - start;
+
+		start = chrono::steady_clock::now();
+		for (const unsigned __int128 n : numbers)
+		{
+			string error;
+			if (!factor_external(n, factors, error))
+			{
+				cerr << "Error: " << error << '\n';
+				backend = abackend;
+				return 1;
+			}
+		}
+		const chrono::duration<double> external = chrono::steady_clock::now() - start;
+
+		cout << bits << " bits:\tBuiltin: " << fixed << setprecision(3) << builtin.count() * 1000 << " ms\tCommand: " << external.count() * 1000 << " ms\n";
+		if (external < builtin)
+		{
+			if (!threshold)
+				threshold = bits;
+		}
+		else
+			threshold = 0;
+
+		if (builtin.count() > 1 or external.count() > 1)
+			break;
+	}
+
+	if (threshold)
+		cout << "\nThe " FACTOR " command is faster from " << threshold << " bits (--factor-threshold " << threshold << ").\n";
+	else
+		cout << "\nThe builtin prime factorization is faster for all of the sizes tested.\n";
+
+	backend = abackend;
+	return 0;
+}
+#endif
+
+/* Prime factors of a number and their exponents, computed once for all of
+   the outputs which need them.  */
+template <typename T>
+struct factorization
+{
+	map<T, size_t> counts;
+
+	factorization() = default;
+
+	explicit factorization(T number)
+	{
+		factor(number, counts);
+	}
+
+	/* Whether the number is prime, which is a single factor with exponent 1.  */
+	bool prime() const
+	{
+		return counts.size() == 1 and counts.begin()->second == 1;
+	}
+};
+
+/* Number of integers in each segment of factor_range().  */
+constexpr size_t RANGE_SEGMENT = 1 << 15;
+
+/* Largest prime to sieve with in factor_range().  The cofactors left are
+   prime when they are less than the square of it, and are otherwise tested
+   and factored one by one.  */
+constexpr uint64_t RANGE_SIEVE_LIMIT = 1 << 21;
+
+/* Call F with each integer from START to END, which must be > 0, and its
+   prime factors.  The integers are factored a segment at a time by sieving
+   with the primes up to the square root of END, or RANGE_SIEVE_LIMIT.  */
+template <typename F>
+void factor_range(const uint64_t start, const uint64_t end, F f)
+{
+	const uint64_t limit = min(isqrt(end), RANGE_SIEVE_LIMIT);
+	vector<uint32_t> primes;
+	for_each_prime(2, limit + 1, [&](const uint64_t p)
+				   { primes.push_back(p); });
+
+	vector<uint64_t> rest(RANGE_SEGMENT);
+	vector<factorization<uint64_t>> factors(RANGE_SEGMENT);
+	for (uint64_t low = start;; low += RANGE_SEGMENT)
+	{
+		const size_t count = min<uint64_t>(end - low, RANGE_SEGMENT - 1) + 1;
+		for (size_t i = 0; i < count; ++i)
+		{
+			rest[i] = low + i;
+			factors[i].counts.clear();
+		}
+
+		/* The primes are in increasing order, so each one goes at the end of
+		   the map.  */
+		for (const uint32_t p : primes)
+		{
+			for (size_t i = (p - low % p) % p; i < count; i += p)
+			{
+				size_t exponent = 0;
+				do
+				{
+					rest[i] /= p;
+					++exponent;
+				} while (!(rest[i] % p));
+				factors[i].counts.emplace_hint(factors[i].counts.cend(), p, exponent);
+			}
+		}
+
+		for (size_t i = 0; i < count; ++i)
+		{
+			uint64_t &t = rest[i];
+			if (t > 1)
+			{
+				if (t / limit <= limit or prime_p(t))
+					++factors[i].counts[t];
+				else
+					factor(t, factors[i].counts);
+			}
+			f(low + i, factors[i]);
+		}
+
+		if (end - low < RANGE_SEGMENT)
+			break;
+	}
+}
+
+/* Residues modulo 30 of the numbers coprime to 30, one for each bit of a
+   byte of sieve_segment(), and the bit for each residue.  */
+constexpr unsigned char WHEEL[] = {1, 7, 11, 13, 17, 19, 23, 29};
+constexpr auto WHEEL_BIT = []() constexpr
+{
+	array<unsigned char, 30> bits{};
+	for (size_t i = 0; i < size(WHEEL); ++i)
+		bits[WHEEL[i]] = i;
+	return bits;
+}();
+
+/* Number of bytes in each segment of sieve_segment(), for 30 numbers each.  */
+constexpr size_t SIEVE_SEGMENT = 1 << 15;
+
+/* Sieve SIEVE, where bit i of byte k is for the number 30 (FIRST + k) +
+   WHEEL[i], with PRIMES, which must be the primes from 7 in increasing
+   order.  The bits left set are for the primes > 5, apart from 1, up to the
+   square of the last of PRIMES.  */
+void sieve_segment(const uint64_t first, vector<unsigned char> &sieve, const vector<uint32_t> &primes)
+{
+	fill(sieve.begin(), sieve.end(), 0xff);
+	const unsigned __int128 low = (unsigned __int128)first * 30;
+	const unsigned __int128 high = low + sieve.size() * 30;
+	for (const uint64_t p : primes)
+	{
+		if ((unsigned __int128)p * p >= high)
+			break;
+		/* The multiples p m from p^2 with m coprime to 30, for each of the
+		   eight residues of m, are p bytes apart.  */
+		const uint64_t m0 = max<unsigned __int128>(p, (low + p - 1) / p);
+		for (const unsigned char w : WHEEL)
+		{
+			const unsigned __int128 n = (unsigned __int128)p * (m0 + (w + 30 - m0 % 30) % 30);
+			if (n >= high)
+				continue;
+			const unsigned char mask = ~(1 << WHEEL_BIT[n % 30]);
+			for (uint64_t k = n / 30 - first; k < sieve.size(); k += p)
+				sieve[k] &= mask;
+		}
+	}
+	if (!first)
+		sieve[0] &= ~1;
+}
+
+template <typename T>
+bool is_prime(const T &n);
+
+/* Largest number that outputprimes() sieves.  Above it, sieving a segment
+   with all of the primes up to its square root takes longer than testing its
+   numbers coprime to 30 one by one, and the primes would take hundreds of
+   MiB near 2^64.  */
+constexpr uint64_t PRIMES_SIEVE_LIMIT = UINT64_C(1) << 51;
+
+/* Set the bits of SIEVE, as from sieve_segment(), for the primes > 5 up to
+   2^64, by testing each number coprime to 30 with is_prime().  */
+void test_segment(const uint64_t first, vector<unsigned char> &sieve)
+{
+	for (size_t k = 0; k < sieve.size(); ++k)
+	{
+		unsigned char bits = 0;
+		for (size_t i = 0; i < size(WHEEL); ++i)
+		{
+			const unsigned __int128 n = (unsigned __int128)(first + k) * 30 + WHEEL[i];
+			if (n <= UINT64_MAX and n > 1 and is_prime<uint64_t>(n))
+				bits |= 1 << i;
+		}
+		sieve[k] = bits;
+	}
+}
+
+/* Output the primes from START to END, one on each line, in increasing order.
+   Segments of a bit-packed sieve of the numbers coprime to 30 are sieved, or
+   tested above PRIMES_SIEVE_LIMIT, and formatted on each thread, then output
+   in order.  */
+void outputprimes(ostream &os, const uint64_t start, const uint64_t end)
+{
+	for (const unsigned p : {2, 3, 5})
+		if (start <= p and p <= end)
+			os << p << '\n';
+
+	vector<uint32_t> primes;
+	for_each_prime(7, start <= PRIMES_SIEVE_LIMIT ? isqrt(min(end, PRIMES_SIEVE_LIMIT)) + 1 : 0, [&](const uint64_t p)
+				   { primes.push_back(p); });
+
+	const unsigned threads = thread_count();
+	vector<vector<unsigned char>> sieves(threads, vector<unsigned char>(SIEVE_SEGMENT));
+	vector<string> buffers(threads);
+	const uint64_t last = end / 30;
+	const auto run = [&](const unsigned i, const uint64_t first)
+	{
+		vector<unsigned char> &sieve = sieves[i];
+		sieve.resize(min<uint64_t>(last - first, SIEVE_SEGMENT - 1) + 1);
+		if (first + sieve.size() <= PRIMES_SIEVE_LIMIT / 30)
+			sieve_segment(first, sieve, primes);
+		else
+			test_segment(first, sieve);
+
+		string &buffer = buffers[i];
+		buffer.clear();
+		char str[numeric_limits<uint64_t>::digits10 + 2];
+		for (size_t k = 0; k < sieve.size(); ++k)
+		{
+			for (unsigned bits = sieve[k]; bits; bits &= bits - 1)
+			{
+				const unsigned char r = WHEEL[__countr_zero(bits)];
+				/* The number is 30 (FIRST + K) + R, which would overflow
+				   past END.  */
+				const uint64_t q = first + k;
+				if (q == last and r > end % 30)
+					break;
+				const uint64_t n = q * 30 + r;
+				if (n < start)
+					continue;
+				char *const p = to_chars(str, str + size(str), n).ptr;
+				*p = '\n';
+				buffer.append(str, p + 1);
+			}
+		}
+	};
+
+	for (uint64_t first = start / 30; first <= last; first += threads * SIEVE_SEGMENT)
+	{
+		vector<thread> workers;
+		unsigned count = 1;
+		for (; count < threads and first + count * SIEVE_SEGMENT <= last; ++count)
+			workers.emplace_back(run, count, first + count * SIEVE_SEGMENT);
+		run(0, first);
+		for (auto &worker : workers)
+			worker.join();
+
+		for (unsigned i = 0; i < count; ++i)
+			os << buffers[i];
+	}
+}
+
+/* Bits of the residues modulo 30 up to each residue in a byte of
+   sieve_segment().  */
+constexpr auto WHEEL_MASK = []() constexpr
+{
+	array<unsigned char, 30> masks{};
+	for (size_t r = 0, i = 0; r < size(masks); ++r)
+	{
+		if (i < size(WHEEL) and WHEEL[i] == r)
+			++i;
+		masks[r] = (1 << i) - 1;
+	}
+	return masks;
+}();
+
+/* Number of primes in the bytes of a sieve from sieve_segment().  */
+inline uint64_t count_primes(const unsigned char *const bytes, const size_t size)
+{
+	uint64_t count = 0;
+	size_t k = 0;
+	for (uint64_t word; k + sizeof(word) <= size; k += sizeof(word))
+	{
+		memcpy(&word, bytes + k, sizeof(word));
+		count += __popcount(word);
+	}
+	for (; k < size; ++k)
+		count += __popcount((unsigned)bytes[k]);
+	return count;
+}
+
+/* Product of the first PHI_TINY primes, and the number of numbers up to it
+   that are coprime to it.  */
+constexpr size_t PHI_TINY = 6;
+constexpr uint32_t PRIMORIAL = 2 * 3 * 5 * 7 * 11 * 13;
+constexpr uint32_t PRIMORIAL_TOTIENT = 1 * 2 * 4 * 6 * 10 * 12;
+
+/* The next multiples of P from the larger of P^2 and 30 FIRST, one for each
+   residue of the multiplier in WHEEL, as bytes of a sieve as from
+   sieve_segment().  */
+inline array<uint64_t, size(WHEEL)> wheel_multiples(const uint64_t p, const uint64_t first)
+{
+	array<uint64_t, size(WHEEL)> multiples;
+	const uint64_t m0 = max(p, (first * 30 + p - 1) / p);
+	for (size_t i = 0; i < size(WHEEL); ++i)
+		multiples[i] = p * (m0 + (WHEEL[i] + 30 - m0 % 30) % 30) / 30;
+	return multiples;
+}
+
+/* Sieve the LENGTH bytes of SEGMENT, from byte FIRST of the sieve, with P,
+   from and then past its MULTIPLES from wheel_multiples(), so that no
+   division is needed for each segment.  F is called with the byte and bit of
+   each multiple before it is cleared.  */
+template <typename F>
+void cross_off(const uint64_t p, array<uint64_t, size(WHEEL)> &multiples, const uint64_t first, unsigned char *const segment, const size_t length, F f)
+{
+	for (size_t i = 0; i < size(WHEEL); ++i)
+	{
+		uint64_t k = multiples[i];
+		if (k < first)
+			k += (first - k + p - 1) / p * p;
+		if (k >= first + length)
+		{
+			multiples[i] = k;
+			continue;
+		}
+		const unsigned shift = WHEEL_BIT[p * WHEEL[i] % 30];
+		for (k -= first; k < length; k += p)
+		{
+			f(k, shift);
+			segment[k] &= ~(1 << shift);
+		}
+		multiples[i] = k + first;
+	}
+}
+
+/* Sizes in bytes of the segments of prime_counter::hard_leaves(), and of the
+   blocks of them with a counter of the numbers left in them, on two
+   levels.  */
+constexpr size_t LEAF_SEGMENT = 1 << 16;
+constexpr size_t LEAF_COUNTER = 1 << 6;
+constexpr size_t LEAF_COUNTERS = 1 << 12;
+
+/* Numbers below which prime_counter counts the primes in a sieve, rather
+   than with the Lagarias-Miller-Odlyzko method.  */
+constexpr uint64_t PRIME_COUNT_SIEVE = 1 << 20;
+
+/* Largest number that prime_counter counts the primes up to, 10^20.  X can
+   need more than 64 bits, but its quotients by the numbers from 6 do not, so
+   the arithmetic narrows to 64 bits after the first division.  */
+constexpr unsigned __int128 PRIME_COUNT_MAX = (unsigned __int128)UINT64_C(10000000000) * UINT64_C(10000000000);
+
+/* Count the primes up to X with the Lagarias-Miller-Odlyzko method:
+   pi(x) = phi(x, a) + a - 1 - P2(x, y), where a = pi(y) for a y between the
+   cube root and the square root of x, phi(x, a) is the number of numbers up
+   to x that are not divisible by any of the first a primes and P2(x, y) is
+   the number of those which are the product of two primes > y.  phi(x, a) is
+   the sum of the ordinary leaves mu(n) phi(x / n, c) for n <= y with
+   lpf(n) > p_c, where c = PHI_TINY, and the special leaves
+   -mu(m) phi(x / (p_b m), b - 1) for m <= y < p_b m with
+   lpf(m) > p_b > p_c.
+   https://www.ams.org/journals/mcom/1985-44-170/S0025-5718-1985-0777285-5/  */
+class prime_counter
+{
+	/* Sieve of the numbers up to LIMIT, as from sieve_segment(), and the
+	   number of primes > 5 before each 8 bytes of it.  */
+	vector<unsigned char> sieve;
+	vector<uint32_t> counts;
+	uint64_t limit;
+
+	/* The primes up to Y, from primes[1] = 2, and (2^64 - 1) / p for each,
+	   to divide by them with a multiplication.  */
+	vector<uint32_t> primes{0, 2, 3, 5};
+	vector<uint64_t> inverses;
+	uint64_t y = 0;
+
+	/* phi(r, PHI_TINY) for r < PRIMORIAL, and the residues coprime to
+	   PRIMORIAL.  */
+	vector<uint16_t> tiny;
+	vector<uint16_t> coprime;
+
+	/* mu(n) lpf(n) for the numbers n up to Y which are coprime to PRIMORIAL,
+	   or 0 if n is not square-free, with lpf(1) = INT32_MAX.  */
+	vector<int32_t> lpf_mu;
+
+	/* Number of numbers up to N that are coprime to PRIMORIAL, which is the
+	   index in lpf_mu after that of N.  */
+	uint64_t rank(const uint64_t n) const
+	{
+		return n / PRIMORIAL * PRIMORIAL_TOTIENT + tiny[n % PRIMORIAL];
+	}
+
+	/* The number at index I of lpf_mu.  */
+	uint64_t unrank(const uint64_t i) const
+	{
+		return i / PRIMORIAL_TOTIENT * PRIMORIAL + coprime[i % PRIMORIAL_TOTIENT];
+	}
+
+	/* Sum of the ordinary leaves, with
+	   phi(x, PHI_TINY) = x / PRIMORIAL * PRIMORIAL_TOTIENT + tiny[x % PRIMORIAL].  */
+	__int128 ordinary_leaves(const unsigned __int128 x) const
+	{
+		__int128 sum = 0;
+		for (uint64_t i = 0; i < lpf_mu.size(); ++i)
+			if (lpf_mu[i])
+			{
+				const unsigned __int128 xn = x / unrank(i);
+				const __int128 phi = (__int128)(xn / PRIMORIAL) * PRIMORIAL_TOTIENT + tiny[xn % PRIMORIAL];
+				sum += lpf_mu[i] < 0 ? -phi : phi;
+			}
+		return sum;
+	}
+
+	/* Sum of the special leaves with x / (p_b m) < p_b^2, so that
+	   phi(x / (p_b m), b - 1) = pi(x / (p_b m)) - b + 2, which is 1 when
+	   x / (p_b m) < p_b.  Then x / (p_b m) is less than the square root of x,
+	   so it is in the sieve.  When p_b^2 > y, m can only be a prime, and the
+	   leaves which are 1 are counted all at once.  The primes p_b are split
+	   between THREADS threads.  */
+	__int128 easy_leaves(const unsigned __int128 x, const unsigned threads) const
+	{
+		const size_t a = primes.size() - 1;
+		atomic<size_t> next = PHI_TINY + 1;
+		vector<__int128> sums(threads);
+		const auto run = [&](const unsigned t)
+		{
+			__int128 sum = 0;
+			for (size_t b; (b = next++) < a;)
+			{
+				const uint64_t p = primes[b];
+				const uint64_t xp = x / p;
+				const uint64_t xp2 = xp / p;
+				const uint64_t xp3 = xp2 / p;
+				if (p * p <= y)
+				{
+					if (xp3 >= y)
+						continue;
+					for (uint64_t i = rank(max<uint64_t>(y / p, xp3)); i < lpf_mu.size(); ++i)
+					{
+						const int32_t e = lpf_mu[i];
+						if (e > (int64_t)p or e < -(int64_t)p)
+						{
+							const __int128 phi = pi(xp / unrank(i)) - b + 2;
+							sum += e < 0 ? phi : -phi;
+						}
+					}
+				}
+				else
+				{
+					const uint64_t trivial = min<uint64_t>(max<uint64_t>(p, xp2), y);
+					sum += a - pi(trivial);
+					const size_t last = pi(trivial);
+					const size_t first = pi(min<uint64_t>(max<uint64_t>(p, xp3), trivial)) + 1;
+					sum -= (__int128)(last + 1 - first) * (b - 2);
+					for (size_t i = first; i <= last; ++i)
+					{
+						uint64_t v = (unsigned __int128)xp * inverses[i] >> 64;
+						v += (v + 1) * primes[i] <= xp;
+						sum += pi(v);
+					}
+				}
+			}
+			sums[t] = sum;
+		};
+		vector<thread> workers;
+		for (unsigned t = 1; t < threads; ++t)
+			workers.emplace_back(run, t);
+		run(0);
+		for (auto &worker : workers)
+			worker.join();
+		return accumulate(sums.cbegin(), sums.cend(), (__int128)0);
+	}
+
+	/* Sum of the rest of the special leaves, with x / (p_b m) >= p_b^2, which
+	   are less than x / y.  The numbers up to x / y which are coprime to 30
+	   are sieved in segments with the primes in increasing order.  Before
+	   sieving with p_b, phi(x / (p_b m), b - 1) is the number left up to
+	   x / (p_b m), less the b - 4 primes from 7 to p_(b-1) themselves.  The
+	   number left up to each leaf comes from counters of the numbers left in
+	   blocks of the segment, which are updated as they are sieved.  Each of
+	   THREADS threads takes a range of the segments at a time, and the
+	   number left in the ranges before it is added afterwards.  */
+	__int128 hard_leaves(const unsigned __int128 x, const unsigned threads) const
+	{
+		/* The leaves p_b m, from the largest m down so that x / (p_b m)
+		   increases, with m > y / p_b, or m a prime > p_b when p_b^2 > y, up to
+		   x / p_b^3.  */
+		const size_t a = primes.size() - 1;
+		vector<uint64_t> xps(a);
+		vector<uint64_t> highest(a), lowest(a);
+		size_t hard = PHI_TINY;
+		for (size_t b = PHI_TINY + 1; b < a; ++b)
+		{
+			const uint64_t p = primes[b];
+			xps[b] = x / p;
+			highest[b] = min<uint64_t>(xps[b] / p / p, y);
+			lowest[b] = p * p <= y ? rank(y / p) : b + 1;
+			if (p * p <= y or highest[b] > p)
+				hard = b;
+			else if (highest[b] < p)
+				break;
+		}
+		if (hard == PHI_TINY)
+			return 0;
+
+		struct chunk
+		{
+			__int128 sum;
+			/* Sum of -mu(m) and the number left in the range, for each b.  */
+			vector<int64_t> mu;
+			vector<uint64_t> count;
+		};
+		vector<chunk> chunks(threads, {0, vector<int64_t>(hard + 1), vector<uint64_t>(hard + 1)});
+
+		const uint64_t bytes = x / y / 30 + 1;
+		const auto run = [&](const unsigned t, const uint64_t begin, const uint64_t end)
+		{
+			chunk &c = chunks[t];
+			c.sum = 0;
+			fill(c.mu.begin(), c.mu.end(), 0);
+			fill(c.count.begin(), c.count.end(), 0);
+
+			const uint64_t low = begin * 30;
+			vector<array<uint64_t, size(WHEEL)>> multiples(hard + 1);
+			for (size_t b = 4; b <= hard; ++b)
+				multiples[b] = wheel_multiples(primes[b], begin);
+
+			/* The index after the next leaf of each b, from the largest m with
+			   x / (p_b m) >= LOW.  */
+			vector<uint64_t> next(hard + 1);
+			for (size_t b = PHI_TINY + 1; b <= hard; ++b)
+			{
+				const uint64_t m = low ? min<uint64_t>(xps[b] / low, highest[b]) : highest[b];
+				next[b] = primes[b] * primes[b] <= y ? rank(m) : pi(m) + 1;
+			}
+
+			vector<unsigned char> segment(LEAF_SEGMENT);
+			vector<uint16_t> counters(LEAF_SEGMENT / LEAF_COUNTER);
+			vector<uint32_t> counters2(LEAF_SEGMENT / LEAF_COUNTERS);
+			for (uint64_t first = begin; first < end; first += LEAF_SEGMENT)
+			{
+				const size_t length = min<uint64_t>(end - first, LEAF_SEGMENT);
+				const uint64_t high = (first + length) * 30;
+
+				/* The second level of counters and the number left in the
+				   segment, from the first.  */
+				uint64_t total = 0;
+				const auto sum_counters = [&]()
+				{
+					total = 0;
+					for (size_t j = 0; j < counters2.size(); ++j)
+					{
+						uint32_t count = 0;
+						for (size_t l = 0; l < LEAF_COUNTERS / LEAF_COUNTER; ++l)
+							count += counters[j * (LEAF_COUNTERS / LEAF_COUNTER) + l];
+						counters2[j] = count;
+						total += count;
+					}
+				};
+
+				fill(segment.begin(), segment.begin() + length, 0xff);
+				for (size_t b = 4; b <= PHI_TINY; ++b)
+					cross_off(primes[b], multiples[b], first, segment.data(), length, [](size_t, unsigned) {});
+				for (size_t k = 0; k < length; k += LEAF_COUNTER)
+					counters[k / LEAF_COUNTER] = count_primes(&segment[k], min(LEAF_COUNTER, length - k));
+				sum_counters();
+
+				for (size_t b = PHI_TINY + 1; b <= hard; ++b)
+				{
+					const uint64_t p = primes[b];
+					const bool table = p * p <= y;
+
+					/* Number left up to each leaf, continuing from the previous
+					   one.  */
+					size_t pos = 0;
+					uint64_t left = 0;
+					for (; next[b] > lowest[b]; --next[b])
+					{
+						const uint64_t i = next[b] - 1;
+						bool negative = true;
+						uint64_t m;
+						if (table)
+						{
+							const int32_t e = lpf_mu[i];
+							if (e <= (int64_t)p and e >= -(int64_t)p)
+								continue;
+							negative = e < 0;
+							m = unrank(i);
+						}
+						else
+							m = primes[i];
+
+						const uint64_t v = xps[b] / m;
+						if (v >= high)
+							break;
+						const size_t q = v / 30 - first;
+						if (pos % LEAF_COUNTER and pos / LEAF_COUNTER < q / LEAF_COUNTER)
+						{
+							const size_t stop = (pos / LEAF_COUNTER + 1) * LEAF_COUNTER;
+							left += count_primes(&segment[pos], stop - pos);
+							pos = stop;
+						}
+						for (; pos % LEAF_COUNTERS and pos + LEAF_COUNTER <= q; pos += LEAF_COUNTER)
+							left += counters[pos / LEAF_COUNTER];
+						for (; pos + LEAF_COUNTERS <= q; pos += LEAF_COUNTERS)
+							left += counters2[pos / LEAF_COUNTERS];
+						for (; pos + LEAF_COUNTER <= q; pos += LEAF_COUNTER)
+							left += counters[pos / LEAF_COUNTER];
+						left += count_primes(&segment[pos], q - pos);
+						pos = q;
+
+						const uint64_t phi = c.count[b] + left + __popcount((unsigned)(segment[q] & WHEEL_MASK[v % 30]));
+						if (negative)
+						{
+							c.sum += phi;
+							++c.mu[b];
+						}
+						else
+						{
+							c.sum -= phi;
+							--c.mu[b];
+						}
+					}
+
+					c.count[b] += total;
+					cross_off(p, multiples[b], first, segment.data(), length, [&](const size_t k, const unsigned shift)
+							  { counters[k / LEAF_COUNTER] -= segment[k] >> shift & 1; });
+					sum_counters();
+				}
+			}
+		};
+
+		/* The ranges double in size, as the leaves are denser at the
+		   start.  */
+		__int128 sum = 0;
+		vector<uint64_t> before(hard + 1);
+		vector<thread> workers(threads - 1);
+		uint64_t span = LEAF_SEGMENT;
+		for (uint64_t first = 0; first < bytes;)
+		{
+			vector<uint64_t> bounds{first};
+			for (unsigned t = 0; t < threads; ++t)
+				bounds.push_back(min(bounds.back() + span, bytes));
+			for (unsigned t = 1; t < threads; ++t)
+				workers[t - 1] = thread(run, t, bounds[t], bounds[t + 1]);
+			run(0, bounds[0], bounds[1]);
+			for (unsigned t = 1; t < threads; ++t)
+				workers[t - 1].join();
+
+			for (const chunk &c : chunks)
+			{
+				sum += c.sum;
+				for (size_t b = PHI_TINY + 1; b <= hard; ++b)
+				{
+					sum += (__int128)c.mu[b] * ((__int128)before[b] - (b - 4));
+					before[b] += c.count[b];
+				}
+			}
+			first = bounds.back();
+			span *= 2;
+		}
+		return sum;
+	}
+
+	uint64_t count_leaves(const unsigned __int128 x) const
+	{
+		const unsigned threads = thread_count();
+		const size_t a = primes.size() - 1;
+		__int128 result = ordinary_leaves(x) + easy_leaves(x, threads) + hard_leaves(x, threads) + a - 1;
+
+		/* P2(x, y) = sum (pi(x / p_i) - (i - 1)) for a < i <= b, where
+		   b = pi(x^(1/2)).  */
+		const uint64_t root = isqrt(x);
+		const uint64_t b = pi(root);
+		result += ((__int128)b * (b - 1) - (__int128)a * (a - 1)) / 2;
+
+		/* The primes p_i from the largest down, so x / p_i increases.  The
+		   values up to the limit are counted from the sieve, and those above
+		   it from segments sieved on each thread.  */
+		uint64_t k = root / 30;
+		unsigned bits = sieve[k] & WHEEL_MASK[root % 30];
+		const auto next_quotient = [&](uint64_t &v)
+		{
+			while (!bits)
+			{
+				if (!k)
+					return false;
+				bits = sieve[--k];
+			}
+			const int bit = 31 - __countl_zero(bits);
+			bits &= ~(1U << bit);
+			const uint64_t p = k * 30 + WHEEL[bit];
+			if (p <= y)
+				return false;
+			v = x / p;
+			return true;
+		};
+
+		uint64_t v;
+		bool more = next_quotient(v);
+		for (; more and v <= limit; more = next_quotient(v))
+			result -= pi(v);
+		if (!more)
+			return result;
+
+		vector<uint32_t> sieving;
+		for (size_t i = 4; i < primes.size() and (uint64_t)primes[i] * primes[i] <= x / y; ++i)
+			sieving.push_back(primes[i]);
+
+		uint64_t base = pi(limit);
+		vector<vector<unsigned char>> segments(threads, vector<unsigned char>(SIEVE_SEGMENT));
+		vector<vector<array<uint64_t, size(WHEEL)>>> multiples(threads);
+		for (auto &amultiples : multiples)
+			for (const uint32_t p : sieving)
+				amultiples.push_back(wheel_multiples(p, sieve.size()));
+		vector<uint64_t> totals(threads);
+		vector<uint64_t> quotients, found;
+		const auto run = [&](const unsigned t, const uint64_t first, const size_t begin, const size_t end)
+		{
+			vector<unsigned char> &segment = segments[t];
+			fill(segment.begin(), segment.end(), 0xff);
+			const uint64_t high = (first + segment.size()) * 30;
+			for (size_t j = 0; j < sieving.size() and (uint64_t)sieving[j] * sieving[j] < high; ++j)
+				cross_off(sieving[j], multiples[t][j], first, segment.data(), segment.size(), [](size_t, unsigned) {});
+			totals[t] = count_primes(segment.data(), segment.size());
+
+			/* Count up to each quotient, continuing from the previous one.  */
+			uint64_t count = 0;
+			size_t done = 0;
+			for (size_t j = begin; j < end; ++j)
+			{
+				const uint64_t q = quotients[j] / 30 - first;
+				count += count_primes(&segment[done], q - done);
+				done = q;
+				found[j] = count + __popcount((unsigned)(segment[q] & WHEEL_MASK[quotients[j] % 30]));
+			}
+		};
+
+		vector<thread> workers(threads - 1);
+		for (uint64_t first = sieve.size(); more; first += threads * SIEVE_SEGMENT)
+		{
+			/* The quotients in the segments of this round.  */
+			const uint64_t end = first + threads * SIEVE_SEGMENT;
+			quotients.clear();
+			for (; more and v / 30 < end; more = next_quotient(v))
+				quotients.push_back(v);
+			found.resize(quotients.size());
+
+			vector<size_t> bounds{0};
+			for (unsigned t = 1; t <= threads; ++t)
+				bounds.push_back(lower_bound(quotients.cbegin(), quotients.cend(), (first + t * SIEVE_SEGMENT) * 30) - quotients.cbegin());
+
+			for (unsigned t = 1; t < threads; ++t)
+				workers[t - 1] = thread(run, t, first + t * SIEVE_SEGMENT, bounds[t], bounds[t + 1]);
+			run(0, first, bounds[0], bounds[1]);
+			for (unsigned t = 1; t < threads; ++t)
+				workers[t - 1].join();
+
+			for (unsigned t = 0; t < threads; ++t)
+			{
+				for (size_t j = bounds[t]; j < bounds[t + 1]; ++j)
+					result -= base + found[j];
+				base += totals[t];
+			}
+		}
+
+		return result;
+	}
+
+public:
+	/* Sieve the numbers up to at least the square root of X, or X if it is
+	   small, and list the primes and factor the numbers up to Y.  */
+	explicit prime_counter(const unsigned __int128 x)
+	{
+		const uint64_t n = x < PRIME_COUNT_SIEVE ? x : isqrt(x);
+		const uint64_t bytes = (n / 30 + 8) & ~7;
+		limit = bytes * 30 - 1;
+		sieve.resize(bytes);
+
+		vector<uint32_t> sieving;
+		for_each_prime(7, isqrt(limit) + 1, [&](const uint64_t p)
+					   { sieving.push_back(p); });
+		vector<unsigned char> segment(SIEVE_SEGMENT);
+		for (uint64_t first = 0; first < bytes; first += SIEVE_SEGMENT)
+		{
+			segment.resize(min<uint64_t>(bytes - first, SIEVE_SEGMENT));
+			sieve_segment(first, segment, sieving);
+			copy(segment.cbegin(), segment.cend(), sieve.begin() + first);
+		}
+
+		counts.resize(bytes / 8);
+		for (size_t i = 1; i < counts.size(); ++i)
+			counts[i] = counts[i - 1] + count_primes(&sieve[(i - 1) * 8], 8);
+
+		if (x < PRIME_COUNT_SIEVE)
+			return;
+
+		/* y = alpha x^(1/3), with alpha growing slowly with the size of x,
+		   which sieves less but has more easy leaves.  */
+		const double alpha = max(1.0, (log10((double)x) - 6) / 2);
+		y = min<uint64_t>(iroot(x, 3) * alpha, isqrt(x));
+		for (uint64_t k = 0; k * 30 <= y; ++k)
+			for (unsigned bits = sieve[k]; bits; bits &= bits - 1)
+			{
+				const uint64_t p = k * 30 + WHEEL[__countr_zero(bits)];
+				if (p > y)
+					break;
+				primes.push_back(p);
+			}
+
+		inverses.resize(primes.size());
+		for (size_t i = 1; i < primes.size(); ++i)
+			inverses[i] = UINT64_MAX / primes[i];
+
+		tiny.resize(PRIMORIAL);
+		for (uint32_t r = 1; r < PRIMORIAL; ++r)
+		{
+			const bool unit = gcd(r, PRIMORIAL) == 1;
+			tiny[r] = tiny[r - 1] + unit;
+			if (unit)
+				coprime.push_back(r);
+		}
+
+		/* Flip the sign for each prime factor, from the smallest, so the
+		   first one sets the magnitude.  */
+		lpf_mu.assign(rank(y), INT32_MAX);
+		for (size_t b = PHI_TINY + 1; b < primes.size(); ++b)
+		{
+			const uint64_t p = primes[b];
+			for (uint64_t i = 0, count = rank(y / p); i < count; ++i)
+			{
+				int32_t &e = lpf_mu[rank(p * unrank(i)) - 1];
+				if (e == INT32_MAX or e == -INT32_MAX)
+					e = e < 0 ? -(int32_t)p : p;
+				e = -e;
+			}
+			if (p <= y / p)
+				for (uint64_t i = 0, count = rank(y / (p * p)); i < count; ++i)
+					lpf_mu[rank(p * p * unrank(i)) - 1] = 0;
+		}
+	}
+
+	/* Number of primes up to N, which must be at most the limit.  */
+	uint64_t pi(const uint64_t n) const
+	{
+		constexpr unsigned char small[] = {0, 0, 1, 2, 2, 3, 3};
+		if (n < size(small))
+			return small[n];
+
+		/* The bytes of the 8 before N, and the bits of N and below in its
+		   byte.  */
+		const uint64_t q = n / 30;
+		uint64_t word;
+		memcpy(&word, &sieve[q & ~7], sizeof(word));
+		if (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+			word = __builtin_bswap64(word);
+		const unsigned shift = (q & 7) * 8;
+		return 3 + counts[q / 8] + __popcount(word & ((((uint64_t)1 << shift) - 1) | (uint64_t)WHEEL_MASK[n % 30] << shift));
+	}
+
+	uint64_t count(const unsigned __int128 x) const
+	{
+		return x <= limit ? pi(x) : count_leaves(x);
+	}
+};
+
+// Output prime factors of number
+template <typename T>
+string outputfactors(const T &number, const bool print_exponents, const bool unicode, const bool all = false, const factorization<T2<T>> *afactorization = nullptr)
+{
+	if (number < 1)
+	{
+		if (all)
+			return "N/A";
+
+		cerr << "Error: Number must be > 0\n";
+		return {};
+	}
+
+	// const T2<T> n = abs(number);
+	const T2<T> &n = number;
+	// n = number < 0 ? -n : n;
+
+	ostringstream strm;
+	factorization<T2<T>> factors;
+	if (!afactorization)
+	{
+		factors = factorization<T2<T>>(n);
+		afactorization = &factors;
+	}
+
+	for (const auto &[prime, exponent] : afactorization->counts)
+	{
+		for (size_t j = 0; j < exponent; ++j)
+		{
+			if (strm.tellp())
+				strm << ' ' << (unicode ? "×" : "*") << ' ';
+			// strm << ' ';
+			if constexpr (is_same_v<T2<T>, unsigned __int128>)
+				strm << outputbase(prime);
+			else
+				strm << prime;
+			if (print_exponents and exponent > 1)
+			{
+				if (unicode)
+					strm << outputexponent(exponent);
+				else
+					strm << '^' << exponent;
+				break;
+			}
+		}
+	}
+
+	return strm.str();
+}
+
+// Get divisors of the product of the prime powers from FIRST to LAST, in ascending order
+template <typename T, typename It>
+vector<T> divisor(It first, const It last)
+{
+	vector<T> divisors{1};
+	divisors.reserve(accumulate(first, last, divisors.size(), [](const size_t sum, const auto &element)
+								{ return sum + (sum * element->second); }));
+
+	for (; first != last; ++first)
+	{
+		const auto &[prime, exponent] = **first;
+		const size_t count = divisors.size();
+		T multiplier = 1;
+		for (size_t j = 0; j < exponent; ++j)
+		{
+			multiplier *= prime;
+			for (size_t i = 0; i < count; ++i)
+				divisors.push_back(divisors[i] * multiplier);
+		}
+	}
+
+	sort(divisors.begin(), divisors.end());
+
+	return divisors;
+}
+
+/* Split the prime powers of a number in two groups with about the same number
+   of divisors, and put the divisors of each group in LOW and HIGH, in
+   ascending order.  Each divisor of the number is the product of one from
+   each.  */
+template <typename T>
+void divisor_groups(const factorization<T> &factors, vector<T> &low, vector<T> &high)
+{
+	using prime_power = typename map<T, size_t>::const_iterator;
+	vector<prime_power> powers;
+	for (auto it = factors.counts.cbegin(); it != factors.counts.cend(); ++it)
+		powers.push_back(it);
+	sort(powers.begin(), powers.end(), [](const prime_power &a, const prime_power &b)
+		 { return a->second > b->second; });
+
+	/* Put each prime power in the group with fewer divisors so far, largest
+	   exponents first.  */
+	vector<prime_power> alow, ahigh;
+	size_t low_count = 1, high_count = 1;
+	for (const prime_power &power : powers)
+	{
+		if (low_count <= high_count)
+		{
+			alow.push_back(power);
+			low_count *= power->second + 1;
+		}
+		else
+		{
+			ahigh.push_back(power);
+			high_count *= power->second + 1;
+		}
+	}
+
+	low = divisor<T>(alow.cbegin(), alow.cend());
+	high = divisor<T>(ahigh.cbegin(), ahigh.cend());
+}
+
+/* Generate the divisors of a number in ascending order from its prime factors,
+   without listing all of them.  The products of the divisors of the two
+   groups from divisor_groups() are merged with a heap, so only about twice
+   the square root of the number of divisors are kept in memory.  */
+template <typename T>
+class divisor_generator
+{
+	struct entry
+	{
+		T value;
+		size_t i, j;
+
+		/* Reversed for a min-heap.  */
+		bool operator<(const entry &other) const
+		{
+			return value > other.value;
+		}
+	};
+
+	vector<T> low, high;
+	vector<entry> heap;
+
+public:
+	explicit divisor_generator(const factorization<T> &factors)
+	{
+		divisor_groups(factors, low, high);
+
+		heap.reserve(low.size());
+		for (size_t i = 0; i < low.size(); ++i)
+			heap.push_back({low[i] * high.front(), i, 0});
+		make_heap(heap.begin(), heap.end());
+	}
+
+	/* Set D to the next divisor.  Return false after the last one, which is
+	   the number itself.  */
+	bool next(T &d)
+	{
+		if (heap.empty())
+			return false;
+
+		pop_heap(heap.begin(), heap.end());
+		entry &top = heap.back();
+		d = top.value;
+		if (++top.j < high.size())
+		{
+			top.value = low[top.i] * high[top.j];
+			push_heap(heap.begin(), heap.end());
+		}
+		else
+			heap.pop_back();
+
+		return true;
+	}
+};
+
+/* Minimum number of divisors to expand them on more than one thread.  */
+constexpr size_t PARALLEL_DIVISORS = 1 << 16;
+
+/* Output the divisors of N below N in ascending order on THREADS threads, from
+   the groups LOW and HIGH of divisor_groups().  The divisors are split into
+   ranges of values with about the same number of divisors, which each thread
+   expands, sorts and formats into its own buffer.  The buffers are then
+   output in order, so only one range for each thread is in memory at once.  */
+template <typename T>
+void outputdivisors_threads(ostream &os, const T &n, const vector<T> &low, const vector<T> &high, const unsigned threads)
+{
+	/* Number of divisors up to X.  */
+	const auto count = [&](const T &x)
+	{
+		size_t count = 0;
+		size_t j = high.size();
+		for (const T &l : low)
+		{
+			const T bound = x / l;
+			while (j and high[j - 1] > bound)
+				--j;
+			if (!j)
+				break;
+			count += j;
+		}
+		return count;
+	};
+
+	/* The ranges end at divisors from either group, which are spread over
+	   all of the values.  */
+	vector<T> ends;
+	set_union(low.cbegin(), low.cend(), high.cbegin(), high.cend(), back_inserter(ends));
+	const size_t total = low.size() * high.size();
+	const size_t size = max(total / (threads * 64), PARALLEL_DIVISORS);
+
+	vector<T> bounds{0};
+	vector<string> buffers(threads);
+	auto next = ends.cbegin();
+	size_t done = 0;
+	bool first = true;
+	while (bounds.back() < n)
+	{
+		/* Find the end of the range for each thread.  */
+		bounds.erase(bounds.begin(), bounds.end() - 1);
+		for (unsigned i = 0; i < threads and bounds.back() < n; ++i)
+		{
+			const size_t target = done + size;
+			next = partition_point(next, ends.cend(), [&](const T &end)
+								   { return count(end) < target; });
+			if (next == ends.cend())
+			{
+				bounds.push_back(n);
+				done = total;
+			}
+			else
+			{
+				bounds.push_back(*next);
+				done = count(*next);
+				++next;
+			}
+		}
+
+		const auto expand = [&](const size_t i)
+		{
+			const T &from = bounds[i], &to = bounds[i + 1];
+			vector<T> divisors;
+			for (const T &l : low)
+			{
+				if (l > to)
+					break;
+				auto it = upper_bound(high.cbegin(), high.cend(), from / l);
+				const auto last = upper_bound(it, high.cend(), to / l);
+				for (; it != last; ++it)
+					divisors.push_back(l * *it);
+			}
+			sort(divisors.begin(), divisors.end());
+
+			ostringstream strm;
+			for (const T &divisor : divisors)
+			{
+				if (divisor == n)
+					break;
+				strm << ' ';
+				if constexpr (is_same_v<T, unsigned __int128>)
+					strm << outputbase(divisor);
+				else
+					strm << divisor;
+			}
+			buffers[i] = strm.str();
+		};
+
+		vector<thread> workers;
+		for (size_t i = 1; i + 1 < bounds.size(); ++i)
+			workers.emplace_back(expand, i);
+		expand(0);
+		for (auto &worker : workers)
+			worker.join();
+
+		/* Each divisor is preceded by a space, except the first one.  */
+		for (size_t i = 0; i + 1 < bounds.size(); ++i)
+		{
+			if (first and !buffers[i].empty())
+			{
+				os.write(buffers[i].data() + 1, buffers[i].size() - 1);
+				first = false;
+			}
+			else
+				os << buffers[i];
+		}
+	}
+}
+
+// Output divisors of number
+template <typename T>
+void outputdivisors(ostream &os, const T &number, const bool all = false, const factorization<T2<T>> *afactorization = nullptr)
+{
+	if (number < 1)
+	{
+		if (all)
+			os << "N/A";
+		else
+			cerr << "Error: Number must be > 0\n";
+		return;
+	}
+
+	// const T2<T> n = abs(number);
+	const T2<T> &n = number;
+	// n = number < 0 ? -n : n;
+
+	factorization<T2<T>> factors;
+	if (!afactorization)
+	{
+		factors = factorization<T2<T>>(n);
+		afactorization = &factors;
+	}
+
+	/* Expand the divisors on several threads if there are many.  */
+	const unsigned threads = thread_count();
+	if (threads > 1)
+	{
+		vector<T2<T>> low, high;
+		divisor_groups(*afactorization, low, high);
+		if (low.size() * high.size() >= PARALLEL_DIVISORS)
+		{
+			outputdivisors_threads(os, n, low, high, threads);
+			return;
+		}
+	}
+
+	/* Stream the divisors as they are generated, since there can be far too
+	   many to hold in memory.  The number itself is not a proper divisor.  */
+	divisor_generator<T2<T>> divisors(*afactorization);
+	T2<T> value;
+	for (bool first = true; divisors.next(value) and value < n; first = false)
+	{
+		if (!first)
+			os << ' ';
+		if constexpr (is_same_v<T2<T>, unsigned __int128>)
+			os << outputbase(value);
+		else
+			os << value;
+	}
+}
+
+/* N in the type R, which is at least as wide.  */
+template <typename R, typename T>
+R widen(const T &n)
+{
+#if HAVE_GMP
+	if constexpr (!is_integral_v<R> and is_same_v<T, unsigned __int128>)
+		return import(n);
+	else
+#endif
+		return R(n);
+}
+
+/* Set R to A * B, or A + B, and return true if it overflows.  */
+template <typename T>
+bool mul_overflow(const T a, const T b, T &r)
+{
+	if constexpr (is_integral_v<T>)
+		return __builtin_mul_overflow(a, b, &r);
+	r = a * b;
+	return false;
+}
+
+template <typename T>
+bool add_overflow(const T a, const T b, T &r)
+{
+	if constexpr (is_integral_v<T>)
+		return __builtin_add_overflow(a, b, &r);
+	r = a + b;
+	return false;
+}
+
+/* Set R to BASE^E by binary powering, and return true if it overflows.  */
+template <typename T>
+bool pow_overflow(T base, unsigned long e, T &r)
+{
+#if HAVE_GMP
+	if constexpr (!is_integral_v<T>)
+	{
+		mpz_pow_ui(r.get_mpz_t(), base.get_mpz_t(), e);
+		return false;
+	}
+	else
+#endif
+	{
+		r = 1;
+		for (; e; e >>= 1)
+		{
+			if (e & 1 and mul_overflow(r, base, r))
+				return true;
+			if (e > 1 and mul_overflow(base, base, base))
+				return true;
+		}
+		return false;
+	}
+}
+
+/* Set SIGMA to the sum of the K-th powers of the divisors, from the prime
+   factors, which is the product of 1 + p^k + p^2k + ... + p^ek over the prime
+   powers p^e of the number, without listing the divisors.  K = 0 gives the
+   number of divisors.  Return false if it does not fit in R.  */
+template <typename R, typename T>
+bool divisor_sigma(const factorization<T> &factors, const unsigned long k, R &sigma)
+{
+	sigma = 1;
+	for (const auto &[prime, exponent] : factors.counts)
+	{
+		const R p = widen<R>(prime);
+		R pk;
+		if (pow_overflow(p, k, pk))
+			return false;
+
+		R power = 1, sum = 1;
+		for (size_t j = 0; j < exponent; ++j)
+			if (mul_overflow(power, pk, power) or add_overflow(sum, power, sum))
+				return false;
+		if (mul_overflow(sigma, sum, sigma))
+			return false;
+	}
+	return true;
+}
+
+/* Call F with the sum of the K-th powers of the divisors, in an unsigned
+   __int128 or, if it does not fit and GMP is present, arbitrary precision.
+   Return false if it does not fit.  */
+template <typename T, typename F>
+bool with_divisor_sigma(const factorization<T> &factors, const unsigned long k, F f)
+{
+	if constexpr (!is_integral_v<T>)
+	{
+		T sigma;
+		divisor_sigma(factors, k, sigma);
+		f(sigma);
+		return true;
+	}
+	else
+	{
+		unsigned __int128 sigma;
+		if (divisor_sigma(factors, k, sigma))
+		{
+			f(sigma);
+			return true;
+		}
+#if HAVE_GMP
+		mpz_class asigma;
+		divisor_sigma(factors, k, asigma);
+		f(asigma);
+		return true;
+#else
+		return false;
+#endif
+	}
+}
+
+// Output aliquot sum of number
+template <typename T>
+string outputaliquot(const T &number, const bool all = false, const factorization<T2<T>> *afactorization = nullptr)
+{
+	if (number < 2)
+	{
+		if (all)
+			return "N/A";
+
+		cerr << "Error: Number must be > 1\n";
+		return {};
+	}
+
+	ostringstream strm;
+	// const T2<T> n = abs(number);
+	const T2<T> &n = number;
+	// n = number < 0 ? -n : n;
+
+	factorization<T2<T>> factors;
+	if (!afactorization)
+	{
+		factors = factorization<T2<T>>(n);
+		afactorization = &factors;
+	}
+
+	/* The sum of the divisors other than the number itself.  */
+	const auto output = [&](const auto &sigma)
+	{
+		using R = remove_cv_t<remove_reference_t<decltype(sigma)>>;
+		const R an = widen<R>(n);
+		const R sum = sigma - an;
+
+		if constexpr (is_same_v<R, unsigned __int128>)
+			strm << outputbase(sum);
+		else
+			strm << sum;
+		strm << " (";
+
+		if (sum == an)
+			strm << "Perfect!";
+		else if (sum < an)
+			strm << "Deficient";
+		else if (sum > an)
+			strm << "Abundant";
+
+		strm << ")";
+	};
+	if (!with_divisor_sigma(*afactorization, 1, output))
+	{
+		cerr << "Error: Aliquot sum too large. Program does not support arbitrary-precision integer numbers, because it was not built with GNU Multiple Precision (GMP).\n";
+		return {};
+	}
+
+	return strm.str();
+}
+
+// Output sum of the K-th powers of the divisors of number
+template <typename T>
+string outputsigma(const T &number, const unsigned long k)
+{
+	if (number < 1)
+	{
+		cerr << "Error: Number must be > 0\n";
+		return {};
+	}
+
+	ostringstream strm;
+	// const T2<T> n = abs(number);
+	const T2<T> &n = number;
+	// n = number < 0 ? -n : n;
+
+	const factorization<T2<T>> factors(n);
+
+	const auto output = [&](const auto &sigma)
+	{
+		if constexpr (is_same_v<remove_cv_t<remove_reference_t<decltype(sigma)>>, unsigned __int128>)
+			strm << outputbase(sigma);
+		else
+			strm << sigma;
+	};
+	if (!with_divisor_sigma(factors, k, output))
+	{
+		cerr << "Error: Sum too large. Program does not support arbitrary-precision integer numbers, because it was not built with GNU Multiple Precision (GMP).\n";
+		return {};
+	}
+
+	return strm.str();
+}
+
+// Output Euler's totient of number
+template <typename T>
+string outputtotient(const T &number)
+{
+	if (number < 1)
+	{
+		cerr << "Error: Number must be > 0\n";
+		return {};
+	}
+
+	ostringstream strm;
+	// const T2<T> n = abs(number);
+	const T2<T> &n = number;
+	// n = number < 0 ? -n : n;
+
+	const factorization<T2<T>> factors(n);
+
+	/* The product of p^(e - 1) (p - 1) over the prime powers p^e, which is at
+	   most the number.  */
+	T2<T> totient = 1;
+	for (const auto &[prime, exponent] : factors.counts)
+	{
+		totient *= prime - 1;
+		for (size_t j = 1; j < exponent; ++j)
+			totient *= prime;
+	}
+
+	if constexpr (is_same_v<T2<T>, unsigned __int128>)
+		strm << outputbase(totient);
+	else
+		strm << totient;
+
+	return strm.str();
+}
+
+// Output K-th smallest divisor of number
+template <typename T>
+string outputkthdivisor(const T &number, const uintmax_t k)
+{
+	if (number < 1)
+	{
+		cerr << "Error: Number must be > 0\n";
+		return {};
+	}
+
+	ostringstream strm;
+	// const T2<T> n = abs(number);
+	const T2<T> &n = number;
+	// n = number < 0 ? -n : n;
+
+	const factorization<T2<T>> factors(n);
+
+	unsigned __int128 count = 1;
+	bool fits = true;
+	for (const auto &[prime, exponent] : factors.counts)
+		if (mul_overflow(count, (unsigned __int128)exponent + 1, count))
+			fits = false;
+	if (fits and k > count)
+	{
+		cerr << "Error: <K> must be at most the number of divisors (" << outputbase(count) << ")\n";
+		return {};
+	}
+
+	/* The divisors pair up as d and n / d, so only generate them up to the
+	   middle, from whichever end is closer.  */
+	const bool largest = fits and k > count / 2;
+	const unsigned __int128 steps = largest ? count + 1 - k : k;
+	divisor_generator<T2<T>> divisors(factors);
+	T2<T> divisor = 1;
+	for (unsigned __int128 i = 0; i < steps; ++i)
+		divisors.next(divisor);
+	if (largest)
+		divisor = n / divisor;
+
+	if constexpr (is_same_v<T2<T>, unsigned __int128>)
+		strm << outputbase(divisor);
+	else
+		strm << divisor;
+
+	return strm.str();
+}
+
+/* BOUND in the type T, or the largest number of T if it is too large.  */
+template <typename T>
+T parse_bound(const char *const bound)
+{
+	if constexpr (is_integral_v<T>)
+	{
+		const unsigned __int128 n = strtou128(bound, nullptr, 0);
+		return n > numeric_limits<T>::max() ? numeric_limits<T>::max() : T(n);
+	}
+	else
+		return T(bound, 0);
+}
+
+/* Put the divisors from FROM to TO which are D times a divisor of the product
+   of the prime powers from index I into DIVISORS.  REST[I] is that product,
+   so D is pruned as soon as it is larger than TO or can no longer reach
+   FROM.  */
+template <typename T>
+void divisors_between(const vector<pair<T, size_t>> &powers, const vector<T> &rest, const size_t i, const T &d, const T &from, const T &to, vector<T> &divisors)
+{
+	if (d > to or d * rest[i] < from)
+		return;
+	if (i == powers.size())
+	{
+		divisors.push_back(d);
+		return;
+	}
+
+	const auto &[prime, exponent] = powers[i];
+	T ad = d;
+	for (size_t j = 0;; ++j)
+	{
+		divisors_between(powers, rest, i + 1, ad, from, to, divisors);
+		if (j == exponent)
+			break;
+		ad *= prime;
+		if (ad > to)
+			break;
+	}
+}
+
+// Output largest divisor of number up to TO
+template <typename T>
+string outputlargestdivisor(const T &number, const char *const ato)
+{
+	if (number < 1)
+	{
+		cerr << "Error: Number must be > 0\n";
+		return {};
+	}
+
+	ostringstream strm;
+	// const T2<T> n = abs(number);
+	const T2<T> &n = number;
+	// n = number < 0 ? -n : n;
+
+	const factorization<T2<T>> factors(n);
+	const T2<T> to = parse_bound<T2<T>>(ato);
+
+	/* Each divisor is the product of one from each group of
+	   divisor_groups(), so walk the two groups from opposite ends, keeping
+	   the largest product up to TO.  Only about twice the square root of the
+	   number of divisors are expanded.  */
+	vector<T2<T>> low, high;
+	divisor_groups(factors, low, high);
+
+	T2<T> divisor = 1;
+	size_t j = high.size();
+	for (const T2<T> &l : low)
+	{
+		if (l > to)
+			break;
+		const T2<T> bound = to / l;
+		while (high[j - 1] > bound)
+			--j;
+		const T2<T> product = l * high[j - 1];
+		if (product > divisor)
+			divisor = product;
+	}
+
+	if constexpr (is_same_v<T2<T>, unsigned __int128>)
+		strm << outputbase(divisor);
+	else
+		strm << divisor;
 
 	return strm.str();
 }
 
+// Output divisors of number from FROM to TO
+template <typename T>
+void outputdivisorsbetween(ostream &os, const T &number, const char *const afrom, const char *const ato)
+{
+	if (number < 1)
+	{
+		cerr << "Error: Number must be > 0\n";
+		return;
+	}
+
+	// const T2<T> n = abs(number);
+	const T2<T> &n = number;
+	// n = number < 0 ? -n : n;
+
+	const factorization<T2<T>> factors(n);
+	const T2<T> from = parse_bound<T2<T>>(afrom), to = parse_bound<T2<T>>(ato);
+
+	/* Largest primes first, so the products exceed TO and are pruned
+	   sooner.  */
+	const vector<pair<T2<T>, size_t>> powers(factors.counts.crbegin(), factors.counts.crend());
+	vector<T2<T>> rest(powers.size() + 1, 1);
+	for (size_t i = powers.size(); i-- > 0;)
+	{
+		rest[i] = rest[i + 1];
+		for (size_t j = 0; j < powers[i].second; ++j)
+			rest[i] *= powers[i].first;
+	}
+
+	vector<T2<T>> divisors;
+	divisors_between(powers, rest, 0, T2<T>(1), from, to, divisors);
+	sort(divisors.begin(), divisors.end());
+
+	for (size_t i = 0; i < divisors.size(); ++i)
+	{
+		if (i)
+			os << ' ';
+		if constexpr (is_same_v<T2<T>, unsigned __int128>)
+			os << outputbase(divisors[i]);
+		else
+			os << divisors[i];
+	}
+}
+
 // https://en.wikipedia.org/wiki/Miller%E2%80%93Rabin_primality_test#Testing_against_small_sets_of_bases
 // https://oeis.org/A006945
 constexpr std::pair<unsigned short, unsigned __int128> PRIME_BASES[] = {
@@ -1763,58 +5279,347 @@ constexpr std::pair<unsigned short, unsigned __int128> PRIME_BASES[] = {
 	// {18, parse_u128("1543267864443420616877677640751301")}
 };
 
-template <typename T>
-bool is_prime(const T &n)
+/* Number of Miller-Rabin bases from the start of PRIME_BASES needed to test N.  */
+template <typename T>
+size_t prime_bases(const T &n)
+{
+	for (const auto &[i, num] : PRIME_BASES)
+		if (n < num)
+			return i;
+
+	return __bit_width(n) >> 1;
+}
+
+/* Miller-Rabin bases for odd numbers below 2^32 without factors <= 41, indexed
+   by hash_base().  Each base is a witness for all of the composites with its
+   hash, which was checked for every number below 2^32.
+   Forisek and Jancina, Fast Primality Testing for Integers That Fit into a
+   Machine Word.  */
+constexpr unsigned char HASHED_BASES[] = {
+	21, 39, 7, 10, 2, 28, 20, 14, 17, 19, 20, 6, 19, 7, 10, 7, 2, 12, 35, 3, 11, 15, 15, 13, 3, 10, 3, 15, 2, 10, 14, 11,
+	7, 11, 6, 10, 30, 7, 10, 5, 30, 19, 11, 15, 2, 6, 14, 7, 6, 13, 6, 3, 14, 13, 7, 3, 6, 2, 6, 7, 18, 11, 19, 15,
+	3, 23, 17, 33, 3, 5, 28, 6, 6, 10, 7, 2, 17, 14, 6, 6, 11, 2, 17, 10, 10, 11, 11, 13, 12, 13, 11, 5, 10, 13, 7, 31,
+	12, 3, 18, 10, 5, 14, 2, 10, 18, 11, 10, 5, 15, 7, 34, 22, 5, 14, 15, 13, 7, 6, 19, 13, 10, 6, 2, 5, 23, 3, 5, 14,
+	2, 5, 21, 50, 6, 13, 6, 5, 20, 11, 29, 3, 13, 10, 18, 7, 7, 2, 5, 28, 14, 2, 3, 21, 11, 11, 5, 10, 10, 13, 5, 5,
+	3, 13, 15, 3, 2, 11, 2, 18, 20, 6, 5, 14, 10, 7, 5, 11, 10, 2, 24, 3, 5, 47, 26, 15, 19, 6, 6, 15, 10, 7, 10, 7,
+	3, 5, 15, 11, 2, 7, 5, 6, 21, 6, 14, 6, 30, 7, 2, 3, 6, 15, 6, 3, 11, 12, 7, 14, 11, 10, 10, 3, 10, 2, 6, 3,
+	3, 3, 7, 10, 10, 6, 2, 3, 11, 5, 13, 10, 22, 10, 22, 28, 19, 6, 5, 10, 2, 13, 22, 26, 5, 38, 6, 5, 7, 14, 11, 3,
+	10, 17, 15, 5, 10, 11, 13, 5, 14, 6, 2, 13, 5, 10, 5, 7, 3, 44, 28, 13, 7, 17, 13, 11, 12, 40, 6, 3, 11, 15, 10, 6,
+	7, 7, 11, 5, 19, 3, 29, 6, 2, 11, 17, 7, 2, 7, 63, 15, 13, 23, 2, 18, 2, 3, 103, 30, 35, 19, 2, 15, 7, 6, 10, 5,
+	3, 13, 14, 17, 6, 13, 41, 2, 11, 13, 18, 3, 20, 6, 7, 6, 15, 7, 2, 7, 24, 11, 3, 5, 7, 15, 3, 5, 2, 23, 14, 11,
+	15, 39, 11, 10, 30, 7, 5, 7, 2, 11, 10, 23, 5, 10, 19, 5, 38, 6, 3, 15, 3, 2, 7, 5, 3, 24, 5, 5, 5, 10, 10, 6,
+	21, 6, 6, 2, 7, 6, 17, 3, 7, 14, 10, 15, 23, 2, 3, 7, 13, 7, 2, 37, 2, 3, 7, 5, 7, 23, 10, 11, 23, 15, 6, 10,
+	3, 5, 10, 3, 21, 23, 5, 24, 7, 11, 2, 11, 19, 17, 2, 15, 6, 23, 7, 5, 11, 7, 10, 39, 2, 2, 3, 10, 5, 6, 38, 21,
+	10, 12, 6, 21, 23, 20, 10, 14, 15, 2, 7, 2, 3, 14, 5, 5, 5, 12, 5, 2, 3, 5, 15, 7, 6, 6, 18, 2, 19, 6, 10, 20,
+	14, 12, 12, 12, 14, 6, 5, 10, 2, 11, 5, 6, 12, 42, 2, 5, 7, 5, 30, 19, 23, 10, 15, 14, 11, 7, 19, 3, 3, 7, 19, 10,
+	2, 5, 5, 2, 20, 15, 6, 12, 2, 2, 13, 6, 10, 2, 3, 35, 6, 5, 6, 3, 7, 19, 5, 6, 2, 5, 11, 17, 28, 11, 7, 13,
+	3, 17, 22, 12, 2, 10, 22, 6, 10, 11, 15, 7, 15, 24, 7, 11, 6, 15, 14, 10, 6, 14, 15, 24, 6, 2, 10, 3, 13, 14, 7, 12,
+	30, 6, 6, 2, 2, 7, 26, 11, 2, 3, 11, 58, 21, 30, 11, 6, 3, 21, 5, 2, 7, 2, 17, 2, 17, 28, 24, 15, 14, 6, 13, 14,
+	2, 13, 3, 13, 2, 2, 7, 5, 23, 2, 13, 21, 11, 2, 6, 2, 57, 18, 11, 7, 10, 2, 13, 7, 7, 42, 5, 10, 6, 2, 12, 2,
+	7, 17, 2, 21, 2, 3, 2, 7, 5, 15, 7, 20, 7, 22, 2, 2, 17, 3, 10, 11, 3, 3, 11, 29, 2, 7, 33, 12, 5, 11, 7, 3,
+	5, 5, 15, 7, 5, 35, 15, 10, 15, 11, 15, 5, 7, 2, 11, 14, 2, 12, 3, 19, 21, 2, 5, 7, 3, 7, 2, 26, 3, 6, 2, 14,
+	19, 22, 11, 18, 21, 15, 10, 18, 2, 3, 6, 39, 6, 15, 7, 6, 11, 22, 2, 2, 5, 24, 11, 7, 5, 5, 5, 5, 30, 10, 22, 3,
+	7, 11, 21, 2, 29, 2, 12, 7, 26, 11, 10, 14, 5, 11, 6, 6, 24, 5, 20, 2, 15, 5, 5, 5, 15, 7, 3, 12, 2, 14, 7, 7,
+	11, 6, 13, 10, 11, 6, 5, 2, 24, 10, 5, 2, 2, 10, 13, 34, 13, 6, 3, 61, 6, 3, 2, 21, 5, 10, 6, 28, 11, 6, 17, 12,
+	7, 6, 6, 3, 31, 7, 14, 30, 17, 2, 2, 5, 2, 10, 3, 17, 5, 7, 22, 5, 17, 5, 11, 30, 33, 3, 3, 15, 7, 7, 2, 5,
+	10, 7, 13, 7, 18, 5, 11, 13, 7, 19, 10, 11, 5, 3, 5, 6, 20, 2, 5, 13, 40, 11, 10, 37, 12, 7, 2, 5, 6, 2, 13, 10,
+	2, 3, 18, 17, 5, 11, 5, 7, 11, 28, 10, 15, 24, 2, 7, 10, 20, 2, 15, 13, 2, 14, 17, 11, 6, 6, 11, 3, 13, 7, 13, 2,
+	11, 10, 6, 5, 15, 5, 11, 10, 13, 3, 6, 3, 3, 12, 5, 2, 3, 7, 2, 15, 3, 11, 22, 7, 2, 26, 5, 7, 5, 7, 17, 14,
+	20, 7, 7, 23, 5, 3, 20, 3, 6, 7, 11, 7, 2, 5, 3, 11, 3, 11, 14, 13, 10, 5, 5, 2, 7, 7, 17, 5, 30, 13, 19, 2,
+	6, 17, 11, 6, 43, 6, 5, 5, 5, 15, 6, 13, 6, 2, 3, 7, 17, 7, 2, 7, 13, 14, 2, 6, 2, 14, 14, 2, 3, 22, 5, 7,
+	17, 10, 15, 10, 2, 7, 6, 3, 2, 15, 12, 7, 13, 15, 19, 14, 2, 10, 6, 3, 26, 17, 6, 11, 11, 6, 20, 7, 10, 3, 11, 7
+};
+
+/* Index in HASHED_BASES of the base for N.  */
+constexpr size_t hash_base(const uint32_t n)
+{
+	uint32_t h = n;
+	h = ((h >> 16) ^ h) * 0x45d9f3b;
+	h = ((h >> 16) ^ h) * 0x45d9f3b;
+	h = (h >> 16) ^ h;
+	return h & (size(HASHED_BASES) - 1);
+}
+
+/* Deterministic Miller-Rabin test of odd N < 2^32 without factors <= 41, with
+   the single base from HASHED_BASES.  */
+bool millerrabin32(const uint32_t n)
+{
+	const montgomery<uint32_t> mont(n);
+	const uint32_t nm1 = n - 1;
+	const size_t s = __countr_zero(nm1);
+
+	return millerrabin(mont, mont.to(HASHED_BASES[hash_base(n)]), nm1 >> s, s);
+}
+
+template <typename T>
+bool is_prime(const T &n)
+{
+	static_assert(is_integral_v<T>);
+	if (n < 2)
+		return false;
+	if (n == 2)
+		return true;
+	if (!(n & 1))
+		return false;
+	constexpr size_t length = get<0>(PRIME_BASES[size(PRIME_BASES) - 1]);
+	for (size_t p = 3, i = 1; i < length; p += primes_diff[i], ++i)
+	{
+		if (n == p)
+			return true;
+		if (!(n % p))
+			return false;
+	}
+
+	/* All composites below 43^2 have a factor <= 41.  */
+	if (n < 43 * 43)
+		return true;
+
+	if (n <= UINT32_MAX and !flag_bpsw)
+		return millerrabin32(n);
+
+	const montgomery<T> mont(n);
+
+	/* No hashed bases are known for 64-bit numbers, but BPSW costs about as
+	   much as three Miller-Rabin tests.  */
+	if (flag_bpsw or n <= UINT64_MAX)
+		return bpsw(mont);
+
+	const T nm1 = n - 1;
+
+	const size_t s = __countr_zero(nm1);
+	const T d = nm1 >> s;
+
+	const size_t num_bases = prime_bases(n);
+
+	T a = 2;
+	for (size_t i = 0; i < num_bases; a += primes_diff[i], ++i)
+	{
+		if (!millerrabin(mont, mont.to(a), d, s))
+			return false;
+	}
+
+	return true;
+}
+
+/* Number of lanes that millerrabin_lanes() runs together.  */
+constexpr size_t BATCH_LANES = 8;
+
+#if defined(__x86_64__) or defined(__i386__)
+/* Montgomery multiplication of four 32-bit numbers, one in the low half of
+   each 64-bit lane.  */
+__attribute__((target("avx2"))) inline __m256i mulredc_avx2(const __m256i a, const __m256i b, const __m256i n, const __m256i ni)
+{
+	const __m256i t = _mm256_mul_epu32(a, b);
+	const __m256i m = _mm256_mul_epu32(t, ni);
+	const __m256i u = _mm256_mul_epu32(m, n);
+	const __m256i th = _mm256_srli_epi64(t, 32);
+	const __m256i uh = _mm256_srli_epi64(u, 32);
+	return _mm256_add_epi64(_mm256_sub_epi64(th, uh), _mm256_and_si256(_mm256_cmpgt_epi64(uh, th), n));
+}
+
+/* Miller-Rabin test with bases A of BATCH_LANES odd numbers N < 2^32 in AVX2
+   registers, four lanes per register.  */
+__attribute__((target("avx2"))) void millerrabin_avx2(const uint64_t *const n, const uint64_t *const a, bool *const results)
+{
+	constexpr size_t vectors = BATCH_LANES / 4;
+	alignas(32) uint64_t an[BATCH_LANES], ani[BATCH_LANES], aone[BATCH_LANES], anm1[BATCH_LANES], ax[BATCH_LANES], aq[BATCH_LANES], ak[BATCH_LANES];
+	size_t bits = 0;
+	uint64_t maxk = 0;
+
+	for (size_t l = 0; l < BATCH_LANES; ++l)
+	{
+		const montgomery<uint32_t> mont(n[l]);
+		const uint32_t nm1 = n[l] - 1;
+		an[l] = n[l];
+		ani[l] = mont.modulus_inverse();
+		aone[l] = mont.one();
+		anm1[l] = mont.minus_one();
+		ax[l] = mont.to(a[l] % n[l]);
+		ak[l] = __countr_zero(nm1);
+		aq[l] = nm1 >> ak[l];
+		bits = max<size_t>(bits, __bit_width(aq[l]));
+		maxk = max(maxk, ak[l]);
+	}
+
+	__m256i vn[vectors], vni[vectors], vone[vectors], vnm1[vectors], vx[vectors], vq[vectors], vk[vectors], vy[vectors], prime[vectors], done[vectors];
+	const __m256i vbit = _mm256_set1_epi64x(1);
+
+	for (size_t v = 0; v < vectors; ++v)
+	{
+		vn[v] = _mm256_load_si256((const __m256i *)&an[v * 4]);
+		vni[v] = _mm256_load_si256((const __m256i *)&ani[v * 4]);
+		vone[v] = _mm256_load_si256((const __m256i *)&aone[v * 4]);
+		vnm1[v] = _mm256_load_si256((const __m256i *)&anm1[v * 4]);
+		vx[v] = _mm256_load_si256((const __m256i *)&ax[v * 4]);
+		vq[v] = _mm256_load_si256((const __m256i *)&aq[v * 4]);
+		vk[v] = _mm256_load_si256((const __m256i *)&ak[v * 4]);
+		vy[v] = vone[v];
+	}
+
+	/* y = x^q, with each lane using its own exponent.  */
+	for (size_t i = 0; i < bits; ++i)
+	{
+		for (size_t v = 0; v < vectors; ++v)
+		{
+			const __m256i mask = _mm256_cmpeq_epi64(_mm256_and_si256(vq[v], vbit), vbit);
+			vy[v] = _mm256_blendv_epi8(vy[v], mulredc_avx2(vy[v], vx[v], vn[v], vni[v]), mask);
+			vx[v] = mulredc_avx2(vx[v], vx[v], vn[v], vni[v]);
+			vq[v] = _mm256_srli_epi64(vq[v], 1);
+		}
+	}
+
+	for (size_t v = 0; v < vectors; ++v)
+	{
+		prime[v] = _mm256_or_si256(_mm256_cmpeq_epi64(vy[v], vone[v]), _mm256_cmpeq_epi64(vy[v], vnm1[v]));
+		done[v] = prime[v];
+	}
+
+	for (uint64_t i = 1; i < maxk; ++i)
+	{
+		const __m256i vi = _mm256_set1_epi64x(i);
+		for (size_t v = 0; v < vectors; ++v)
+		{
+			vy[v] = mulredc_avx2(vy[v], vy[v], vn[v], vni[v]);
+			const __m256i active = _mm256_andnot_si256(done[v], _mm256_cmpgt_epi64(vk[v], vi));
+			const __m256i found = _mm256_and_si256(active, _mm256_cmpeq_epi64(vy[v], vnm1[v]));
+			prime[v] = _mm256_or_si256(prime[v], found);
+			done[v] = _mm256_or_si256(done[v], _mm256_or_si256(found, _mm256_and_si256(active, _mm256_cmpeq_epi64(vy[v], vone[v]))));
+		}
+	}
+
+	for (size_t v = 0; v < vectors; ++v)
+	{
+		const int mask = _mm256_movemask_pd(_mm256_castsi256_pd(prime[v]));
+		for (size_t l = 0; l < 4; ++l)
+			results[v * 4 + l] = mask & (1 << l);
+	}
+}
+#endif
+
+/* Miller-Rabin test with bases A of BATCH_LANES odd numbers N, in
+   structure-of-arrays layout.  The lanes are independent, so their
+   Montgomery multiplications can overlap in the pipeline.  */
+void millerrabin_lanes(const uint64_t *const n, const uint64_t *const a, bool *const results)
 {
-	static_assert(is_integral_v<T>);
-	if (n < 2)
-		return false;
-	if (n == 2)
-		return true;
-	if (!(n & 1))
-		return false;
-	constexpr size_t length = get<0>(PRIME_BASES[size(PRIME_BASES) - 1]);
-	for (size_t p = 3, i = 1; i < length; p += primes_diff[i], ++i)
+#if defined(__x86_64__) or defined(__i386__)
+	static const bool avx2 = __builtin_cpu_supports("avx2");
+	if (avx2 and all_of(n, n + BATCH_LANES, [](const uint64_t an)
+						{ return an <= UINT32_MAX; }))
 	{
-		if (n == p)
-			return true;
-		if (!(n % p))
-			return false;
+		millerrabin_avx2(n, a, results);
+		return;
 	}
+#endif
 
-	const T nm1 = n - 1;
+	montgomery<uint64_t> mont[BATCH_LANES];
+	uint64_t x[BATCH_LANES], y[BATCH_LANES], q[BATCH_LANES], k[BATCH_LANES];
+	bool done[BATCH_LANES];
+	size_t bits = 0;
+	uint64_t maxk = 0;
 
-	const size_t s = __countr_zero(nm1);
-	const T d = nm1 >> s;
+	for (size_t l = 0; l < BATCH_LANES; ++l)
+	{
+		mont[l] = montgomery<uint64_t>(n[l]);
+		const uint64_t nm1 = n[l] - 1;
+		k[l] = __countr_zero(nm1);
+		q[l] = nm1 >> k[l];
+		x[l] = mont[l].to(a[l] % n[l]);
+		y[l] = mont[l].one();
+		bits = max<size_t>(bits, __bit_width(q[l]));
+		maxk = max(maxk, k[l]);
+	}
 
-	size_t num_bases = 0;
-	for (const auto &[i, num] : PRIME_BASES)
+	for (size_t i = 0; i < bits; ++i)
 	{
-		if (n < num)
+		for (size_t l = 0; l < BATCH_LANES; ++l)
 		{
-			num_bases = i;
-			break;
+			const uint64_t t = mont[l].mul(y[l], x[l]);
+			y[l] = q[l] & 1 ? t : y[l];
+			x[l] = mont[l].mul(x[l], x[l]);
+			q[l] >>= 1;
 		}
 	}
-	if (!num_bases)
+
+	for (size_t l = 0; l < BATCH_LANES; ++l)
 	{
-		const size_t idx = __bit_width(n) >> 1;
-		num_bases = idx;
+		results[l] = y[l] == mont[l].one() or y[l] == mont[l].minus_one();
+		done[l] = results[l];
 	}
 
-	T a = 2;
-	for (size_t i = 0; i < num_bases; a += primes_diff[i], ++i)
+	for (uint64_t i = 1; i < maxk; ++i)
 	{
-		if (!millerrabin(n, nm1, a, d, s))
-			return false;
+		for (size_t l = 0; l < BATCH_LANES; ++l)
+		{
+			y[l] = mont[l].mul(y[l], y[l]);
+			if (!done[l] and i < k[l])
+			{
+				if (y[l] == mont[l].minus_one())
+					results[l] = done[l] = true;
+				else if (y[l] == mont[l].one())
+					done[l] = true;
+			}
+		}
 	}
+}
 
-	return true;
+/* Test if each of the COUNT numbers N is prime, storing the results in
+   RESULTS.  Gives the same results as is_prime(), but runs the Miller-Rabin
+   tests on BATCH_LANES numbers at a time.  */
+void is_prime_batch(const uint64_t *const n, bool *const results, const size_t count)
+{
+	constexpr size_t length = get<0>(PRIME_BASES[size(PRIME_BASES) - 1]);
+	vector<size_t> pending;
+
+	for (size_t j = 0; j < count; ++j)
+	{
+		const uint64_t an = n[j];
+		results[j] = an == 2 or (an > 2 and (an & 1));
+		if (!results[j] or an == 2)
+			continue;
+		bool small = false;
+		for (size_t p = 3, i = 1; i < length; p += primes_diff[i], ++i)
+		{
+			if (an == p or !(an % p))
+			{
+				results[j] = an == p;
+				small = true;
+				break;
+			}
+		}
+		if (small or an < 43 * 43)
+			continue;
+		pending.push_back(j);
+	}
+
+	/* The hashed base for numbers below 2^32 and otherwise base 2, the first
+	   half of BPSW.  */
+	for (size_t j = 0; j < pending.size(); j += BATCH_LANES)
+	{
+		uint64_t an[BATCH_LANES];
+		uint64_t a[BATCH_LANES];
+		bool aresults[BATCH_LANES];
+		const size_t lanes = min(BATCH_LANES, pending.size() - j);
+		for (size_t l = 0; l < BATCH_LANES; ++l)
+		{
+			/* Pad the last batch with a copy of its first number.  */
+			an[l] = n[pending[j + (l < lanes ? l : 0)]];
+			a[l] = an[l] <= UINT32_MAX and !flag_bpsw ? HASHED_BASES[hash_base(an[l])] : 2;
+		}
+
+		millerrabin_lanes(an, a, aresults);
+
+		for (size_t l = 0; l < lanes; ++l)
+			results[pending[j + l]] = aresults[l];
+	}
+
+	for (const size_t j : pending)
+		if (results[j] and (n[j] > UINT32_MAX or flag_bpsw))
+			results[j] = strong_lucas(montgomery<uint64_t>(n[j]));
 }
 
 // Output if number is prime or composite
 template <typename T>
-string outputprime(const T &number, const bool all = false)
+string outputprime(const T &number, const bool all = false, const factorization<T2<T>> *afactorization = nullptr)
 {
 	if (number < 2)
 	{
@@ -1830,17 +5635,24 @@ string outputprime(const T &number, const bool all = false)
 	// n = number < 0 ? -n : n;
 	bool ais_prime;
 
+	if (afactorization)
+		ais_prime = afactorization->prime();
 #if HAVE_GMP
-	if constexpr (!is_integral_v<T2<T>>)
+	else if constexpr (!is_integral_v<T2<T>>)
 	{
-		const size_t idx = mpz_sizeinbase(n.get_mpz_t(), 2) >> 1;
-		ais_prime = mpz_probab_prime_p(n.get_mpz_t(), min<size_t>(idx, INT_MAX));
+		if (flag_bpsw)
+			ais_prime = mpz_odd_p(n.get_mpz_t()) and bpsw(mpz_modular(n));
+		else
+		{
+			const size_t idx = mpz_sizeinbase(n.get_mpz_t(), 2) >> 1;
+			ais_prime = mpz_probab_prime_p(n.get_mpz_t(), min<size_t>(idx, INT_MAX));
+		}
 	}
 	else
 #endif
 		ais_prime = is_prime(n);
 
-	return ais_prime ? "Prime!" : "Composite (Not prime)";
+	return primality[ais_prime];
 }
 
 // Convert fractions and constants to Unicode characters
@@ -1959,10 +5771,13 @@ void outputall(const T ll, char const *unit_separator, const bool print_exponent
 
 	cout << "\n\n\tText:\t\t\t\t" << outputtext(ll, special);
 
-	cout << "\n\n\tPrime Factors:\t\t\t" << outputfactors(ll, print_exponents, unicode, true);
-	cout << "\n\tDivisors:\t\t\t" << outputdivisors(ll, true);
-	cout << "\n\tAliquot sum:\t\t\t" << outputaliquot(ll, true);
-	cout << "\n\tPrime or composite:\t\t" << outputprime(ll, true) << "\n";
+	/* Factor the number once for all of the outputs below.  */
+	const auto afactorization = ll > 0 ? factorization<T2<T>>(ll) : factorization<T2<T>>();
+	cout << "\n\n\tPrime Factors:\t\t\t" << outputfactors(ll, print_exponents, unicode, true, &afactorization);
+	cout << "\n\tDivisors:\t\t\t";
+	outputdivisors(cout, ll, true, &afactorization);
+	cout << "\n\tAliquot sum:\t\t\t" << outputaliquot(ll, true, &afactorization);
+	cout << "\n\tPrime or composite:\t\t" << outputprime(ll, true, &afactorization) << "\n";
 }
 
 // Output all for arbitrary-precision integer numbers
@@ -2013,10 +5828,13 @@ void outputall(const mpz_class &num, const bool print_exponents, const bool unic
 
 	cout << "\n\n\tText:\t\t\t\t" << outputtext(num, special);
 
-	cout << "\n\n\tPrime Factors:\t\t\t" << outputfactors(num, print_exponents, unicode, true);
-	cout << "\n\tDivisors:\t\t\t" << outputdivisors(num, true);
-	cout << "\n\tAliquot sum:\t\t\t" << outputaliquot(num, true);
-	cout << "\n\tPrime or composite:\t\t" << outputprime(num, true) << "\n";
+	/* Factor the number once for all of the outputs below.  */
+	const auto afactorization = num > 0 ? factorization<T2<mpz_class>>(num) : factorization<T2<mpz_class>>();
+	cout << "\n\n\tPrime Factors:\t\t\t" << outputfactors(num, print_exponents, unicode, true, &afactorization);
+	cout << "\n\tDivisors:\t\t\t";
+	outputdivisors(cout, num, true, &afactorization);
+	cout << "\n\tAliquot sum:\t\t\t" << outputaliquot(num, true, &afactorization);
+	cout << "\n\tPrime or composite:\t\t" << outputprime(num, true, &afactorization) << "\n";
 }
 #endif
 
@@ -2112,11 +5930,29 @@ int integers(const char *const token, const int frombase, const short tobase, co
 						cout << outputfactors(num, print_exponents, unicode);
 						break;
 					case 'd':
-						cout << outputdivisors(num);
+						outputdivisors(cout, num);
 						break;
 					case 's':
 						cout << outputaliquot(num);
 						break;
+					case SIGMA_OPTION:
+						cout << outputsigma(num, sigma_k);
+						break;
+					case TAU_OPTION:
+						cout << outputsigma(num, 0);
+						break;
+					case TOTIENT_OPTION:
+						cout << outputtotient(num);
+						break;
+					case KTH_DIVISOR_OPTION:
+						cout << outputkthdivisor(num, divisor_k);
+						break;
+					case DIVISORS_BETWEEN_OPTION:
+						outputdivisorsbetween(cout, num, divisors_from, divisors_to);
+						break;
+					case LARGEST_DIVISOR_OPTION:
+						cout << outputlargestdivisor(num, divisors_to);
+						break;
 					case 'n':
 						cout << outputprime(num);
 						break;
@@ -2174,11 +6010,29 @@ int integers(const char *const token, const int frombase, const short tobase, co
 					cout << outputfactors(i128, print_exponents, unicode);
 					break;
 				case 'd':
-					cout << outputdivisors(i128);
+					outputdivisors(cout, i128);
 					break;
 				case 's':
 					cout << outputaliquot(i128);
 					break;
+				case SIGMA_OPTION:
+					cout << outputsigma(i128, sigma_k);
+					break;
+				case TAU_OPTION:
+					cout << outputsigma(i128, 0);
+					break;
+				case TOTIENT_OPTION:
+					cout << outputtotient(i128);
+					break;
+				case KTH_DIVISOR_OPTION:
+					cout << outputkthdivisor(i128, divisor_k);
+					break;
+				case DIVISORS_BETWEEN_OPTION:
+					outputdivisorsbetween(cout, i128, divisors_from, divisors_to);
+					break;
+				case LARGEST_DIVISOR_OPTION:
+					cout << outputlargestdivisor(i128, divisors_to);
+					break;
 				case 'n':
 					cout << outputprime(i128);
 					break;
@@ -2236,11 +6090,29 @@ int integers(const char *const token, const int frombase, const short tobase, co
 				cout << outputfactors(ll, print_exponents, unicode);
 				break;
 			case 'd':
-				cout << outputdivisors(ll);
+				outputdivisors(cout, ll);
 				break;
 			case 's':
 				cout << outputaliquot(ll);
 				break;
+			case SIGMA_OPTION:
+				cout << outputsigma(ll, sigma_k);
+				break;
+			case TAU_OPTION:
+				cout << outputsigma(ll, 0);
+				break;
+			case TOTIENT_OPTION:
+				cout << outputtotient(ll);
+				break;
+			case KTH_DIVISOR_OPTION:
+				cout << outputkthdivisor(ll, divisor_k);
+				break;
+			case DIVISORS_BETWEEN_OPTION:
+				outputdivisorsbetween(cout, ll, divisors_from, divisors_to);
+				break;
+			case LARGEST_DIVISOR_OPTION:
+				cout << outputlargestdivisor(ll, divisors_to);
+				break;
 			case 'n':
 				cout << outputprime(ll);
 				break;
@@ -2251,6 +6123,76 @@ int integers(const char *const token, const int frombase, const short tobase, co
 	return 0;
 }
 
+/* Number of numbers to read before testing them together with --prime.  */
+constexpr size_t BATCH_SIZE = 1 << 12;
+
+// Handle integer numbers with --prime, testing the numbers that fit in 64 bits together
+int integers_batch(const vector<string> &tokens, const int frombase, const short tobase, const bool unicode, const bool uppercase, const bool special, const bool print_exponents, const scale_type scale_to, char const *unit_separator, const int arg)
+{
+	vector<uint64_t> numbers;
+	numbers.reserve(tokens.size());
+	vector<bool> batched(tokens.size());
+
+	for (size_t i = 0; i < tokens.size(); ++i)
+	{
+		const char *const token = tokens[i].c_str();
+		char *p;
+		errno = 0;
+		const uintmax_t n = strtoumax(token, &p, frombase);
+		if (!*p and errno != ERANGE and !strchr(token, '-') and n > 1)
+		{
+			numbers.push_back(n);
+			batched[i] = true;
+		}
+	}
+
+	if (dev_debug)
+		cerr << "[batch primality test of " << numbers.size() << " numbers] ";
+
+	const unique_ptr<bool[]> results(new bool[numbers.size()]);
+	is_prime_batch(numbers.data(), results.get(), numbers.size());
+
+	int ret = 0;
+	for (size_t i = 0, j = 0; i < tokens.size(); ++i)
+	{
+		if (batched[i])
+		{
+			cout << numbers[j] << ": " << primality[results[j]] << '\n';
+			++j;
+		}
+		else
+			ret |= integers(tokens[i].c_str(), frombase, tobase, unicode, uppercase, special, print_exponents, scale_to, unit_separator, arg);
+	}
+
+	return ret;
+}
+
+// Handle integer numbers from START to END with --range, factoring them together
+int integers_range(const uint64_t start, const uint64_t end, const bool unicode, const bool print_exponents, const int arg)
+{
+	factor_range(start, end, [&](const uint64_t n, const factorization<uint64_t> &factors)
+				 {
+		cout << n << ": ";
+		switch (arg)
+		{
+		case 'p':
+			cout << outputfactors(n, print_exponents, unicode, false, &factors);
+			break;
+		case 'd':
+			outputdivisors(cout, n, false, &factors);
+			break;
+		case 's':
+			cout << outputaliquot(n, false, &factors);
+			break;
+		case 'n':
+			cout << outputprime(n, false, &factors);
+			break;
+		}
+		cout << '\n'; });
+
+	return 0;
+}
+
 // Handle floating point numbers
 int floats(const char *const token, const scale_type scale_to, char const *unit_separator, const int arg)
 {
@@ -2294,6 +6236,51 @@ int floats(const char *const token, const scale_type scale_to, char const *unit_
 	return 0;
 }
 
+/* The second argument of OPTION, which takes two, from the next argument.  */
+const char *second_argument(const char *const option, const int argc, char *const argv[])
+{
+	if (optind >= argc)
+	{
+		cerr << "Usage: " << option << " requires two arguments\n";
+		return nullptr;
+	}
+	return argv[optind++];
+}
+
+/* Set VALUE to the integer number ARG, which must not be negative and must fit
+   in T.  */
+template <typename T>
+bool integer_argument(const char *const arg, T &value)
+{
+	char *p;
+	errno = 0;
+	const unsigned __int128 n = strtou128(arg, &p, 0);
+	if (!*arg or *arg == '-' or *p or errno == ERANGE or n > numeric_limits<T>::max())
+	{
+		cerr << "Error: Invalid integer number: " << quoted(arg) << ".\n";
+		return false;
+	}
+	value = n;
+	return true;
+}
+
+/* Set START and END from the arguments of OPTION.  */
+bool range_arguments(const char *const option, const int argc, char *const argv[], uintmax_t &start, uintmax_t &end)
+{
+	const char *const aend = second_argument(option, argc, argv);
+	if (!aend)
+		return false;
+
+	if (!integer_argument(optarg, start) or !integer_argument(aend, end))
+		return false;
+	if (start > end)
+	{
+		cerr << "Error: <START> must be at most <END>.\n";
+		return false;
+	}
+	return true;
+}
+
 // Output usage
 void usage(const char *const programname)
 {
@@ -2341,14 +6328,48 @@ Options:
                                 Numbers > 0, supports arbitrary-precision/bignums if factor command was also built with GNU Multiple Precision.
         -s, --aliquot       Output aliquot sum (sum of all divisors) and if it is perfect, deficient or abundant
                                 Numbers > 1, supports arbitrary-precision/bignums if factor command was also built with GNU Multiple Precision.
+            --sigma-k <K>   Output sum of the K-th powers of all divisors (divisor function σ_k)
+                                K ≤ 1000. Numbers > 0, supports arbitrary-precision/bignums if factor command was also built with GNU Multiple Precision.
+            --tau, --divisor-count Output number of divisors
+                                Numbers > 0, supports arbitrary-precision/bignums if factor command was also built with GNU Multiple Precision.
+            --kth-divisor <K> Output K-th smallest divisor, counting from 1 (including the number itself)
+                                Numbers > 0, supports arbitrary-precision/bignums if factor command was also built with GNU Multiple Precision.
+            --divisors-between <A> <B> Output divisors from A to B (including the number itself)
+                                Numbers > 0, supports arbitrary-precision/bignums if factor command was also built with GNU Multiple Precision.
+            --largest-divisor <X> Output largest divisor up to X (including the number itself)
+                                Numbers > 0, supports arbitrary-precision/bignums if factor command was also built with GNU Multiple Precision.
+            --totient       Output Euler's totient (count of the numbers up to it which are coprime to it)
+                                Numbers > 0, supports arbitrary-precision/bignums if factor command was also built with GNU Multiple Precision.
         -n, --prime         Output if it is prime or composite
-                                Numbers > 1, supports arbitrary-precision/bignums if factor command was also built with GNU Multiple Precision.)d"
-#ifndef FACTOR
+                                Numbers > 1, supports arbitrary-precision/bignums if factor command was also built with GNU Multiple Precision.
+            --range <START> <END> Output for each integer number from START to END, instead of the numbers given
+                                Only affects --factors, --divisors, --aliquot and --prime. Numbers > 0 and < 2^64, which are factored together with a segmented sieve.
+            --primes <START> <END> Output the prime numbers from START to END, one on each line
+                                Numbers < 2^64, with a segmented sieve on each thread (see --threads), or primality tests above 2^51.
+            --prime-count <X> Output the number of prime numbers up to X (prime-counting function π)
+                                Numbers ≤ 10^20, with the Lagarias-Miller-Odlyzko method on each thread (see --threads).)d"
 		 << R"(
         -w, --prove-primality Run probabilistic tests instead of proving the primality of factors
                                 Only affects --factors, --divisors, --aliquot and --prime.)"
+		 << R"(
+            --ecm-b1 <B1>   Stage 1 bound for the elliptic curve method (ECM)
+                                Default: increasing bounds for larger factors. Only affects --factors, --divisors, --aliquot and --prime when trial division leaves a composite > 2^64.
+            --ecm-b2 <B2>   Stage 2 bound for ECM (default: 100 * <B1>)
+            --ecm-curves <N> Number of ECM curves for each stage 1 bound
+                                Default: enough to find most factors of each size, or until a factor is found with --ecm-b1.
+            --threads <N>   Number of threads for factoring the composites left by trial division, for expanding many divisors and for finding primes
+                                Default: one on each core. Only affects --factors, --divisors, --aliquot, --prime, --primes and --prime-count.)"
+#ifdef FACTOR
+		 << R"(
+            --factor-backend <BACKEND> Prime factorization to use: builtin, external (the ')" FACTOR R"(' command) or auto
+                                Default: auto, which uses the command for the composites left by trial division with at least --factor-threshold bits.
+            --factor-threshold <BITS> Number of bits from which auto uses the command (default: 256)
+            --calibrate     Time the builtin prime factorization and the command on this computer, output the number of bits from which the command is faster and exit)"
 #endif
 		 << R"(
+            --bpsw          Run the Baillie-PSW test instead of proving the primality of factors or running other probabilistic tests
+                                No composites < 2^64 pass it and none larger are known. Only affects --factors, --divisors, --aliquot and --prime.)"
+		 << R"(
         -a, --all           Output all of the above (default)
         Except when otherwise noted above, this program supports all Integer numbers )"
 		 << outputbase(INT128_MIN) << " - " << outputbase(INT128_MAX) << R"d(.
@@ -2430,7 +6451,16 @@ int main(int argc, char *argv[])
 	bool print_exponents = false;
 	enum scale_type scale_to = scale_none;
 	char const *unit_separator = nullptr;
-	int arg = 'a';
+	int arg = 0;
+	bool ranging = false;
+	/* --primes or --prime-count, which replace the output for each number.  */
+	int listing = 0;
+	uintmax_t range_start = 0;
+	uintmax_t range_end = 0;
+	unsigned __int128 prime_count_x = 0;
+#ifdef FACTOR
+	bool calibrating = false;
+#endif
 
 	setlocale(LC_ALL, "");
 
@@ -2463,9 +6493,29 @@ int main(int argc, char *argv[])
 		{"factors", no_argument, nullptr, 'p'},
 		{"exponents", no_argument, nullptr, 'h'},
 		{"prove-primality", no_argument, nullptr, 'w'},
+		{"bpsw", no_argument, nullptr, BPSW_OPTION},
+		{"ecm-b1", required_argument, nullptr, ECM_B1_OPTION},
+		{"ecm-b2", required_argument, nullptr, ECM_B2_OPTION},
+		{"ecm-curves", required_argument, nullptr, ECM_CURVES_OPTION},
+		{"threads", required_argument, nullptr, THREADS_OPTION},
+#ifdef FACTOR
+		{"factor-backend", required_argument, nullptr, FACTOR_BACKEND_OPTION},
+		{"factor-threshold", required_argument, nullptr, FACTOR_THRESHOLD_OPTION},
+		{"calibrate", no_argument, nullptr, CALIBRATE_OPTION},
+#endif
 		{"divisors", no_argument, nullptr, 'd'},
 		{"aliquot", no_argument, nullptr, 's'},
+		{"sigma-k", required_argument, nullptr, SIGMA_OPTION},
+		{"tau", no_argument, nullptr, TAU_OPTION},
+		{"divisor-count", no_argument, nullptr, TAU_OPTION},
+		{"kth-divisor", required_argument, nullptr, KTH_DIVISOR_OPTION},
+		{"divisors-between", required_argument, nullptr, DIVISORS_BETWEEN_OPTION},
+		{"largest-divisor", required_argument, nullptr, LARGEST_DIVISOR_OPTION},
+		{"totient", no_argument, nullptr, TOTIENT_OPTION},
 		{"prime", no_argument, nullptr, 'n'},
+		{"range", required_argument, nullptr, RANGE_OPTION},
+		{"primes", required_argument, nullptr, PRIMES_OPTION},
+		{"prime-count", required_argument, nullptr, PRIME_COUNT_OPTION},
 		{"all", no_argument, nullptr, 'a'},
 		{"float", no_argument, nullptr, 'f'},
 		{"fracts", no_argument, nullptr, 'c'},
@@ -2498,8 +6548,57 @@ int main(int argc, char *argv[])
 		case 's':
 		case 't':
 		case BRAILLE_OPTION:
+		case TAU_OPTION:
+		case TOTIENT_OPTION:
+			arg = c;
+			break;
+		case SIGMA_OPTION:
+			arg = c;
+			if (!integer_argument(optarg, sigma_k))
+				return 1;
+			if (sigma_k > SIGMA_MAX_K)
+			{
+				cerr << "Error: <K> must be ≤ " << SIGMA_MAX_K << ".\n";
+				return 1;
+			}
+			break;
+		case KTH_DIVISOR_OPTION:
+			arg = c;
+			if (!integer_argument(optarg, divisor_k))
+				return 1;
+			if (divisor_k < 1)
+			{
+				cerr << "Error: <K> must be > 0.\n";
+				return 1;
+			}
+			break;
+		case DIVISORS_BETWEEN_OPTION:
+			arg = c;
+			divisors_from = optarg;
+			divisors_to = second_argument("--divisors-between", argc, argv);
+			if (!divisors_to)
+				return 1;
+			for (const char *const bound : {divisors_from, divisors_to})
+			{
+				unsigned __int128 value;
+				if (!integer_argument(bound, value))
+					return 1;
+			}
+			break;
+		case LARGEST_DIVISOR_OPTION:
+		{
 			arg = c;
+			divisors_to = optarg;
+			unsigned __int128 to;
+			if (!integer_argument(optarg, to))
+				return 1;
+			if (to < 1)
+			{
+				cerr << "Error: <X> must be > 0.\n";
+				return 1;
+			}
 			break;
+		}
 		case 'c':
 		case 'g':
 		case 'm':
@@ -2578,6 +6677,92 @@ int main(int argc, char *argv[])
 		case 'w':
 			flag_prove_primality = false;
 			break;
+		case BPSW_OPTION:
+			flag_bpsw = true;
+			break;
+		case ECM_B1_OPTION:
+			if (!integer_argument(optarg, ecm_b1))
+				return 1;
+			if (ecm_b1 < 2 or ecm_b1 > ECM_MAX_B2)
+			{
+				cerr << "Error: <B1> must be 2 - " << ECM_MAX_B2 << ".\n";
+				return 1;
+			}
+			break;
+		case ECM_B2_OPTION:
+			if (!integer_argument(optarg, ecm_b2))
+				return 1;
+			if (ecm_b2 < 2 or ecm_b2 > ECM_MAX_B2)
+			{
+				cerr << "Error: <B2> must be 2 - " << ECM_MAX_B2 << ".\n";
+				return 1;
+			}
+			break;
+		case ECM_CURVES_OPTION:
+			if (!integer_argument(optarg, ecm_curves))
+				return 1;
+			if (ecm_curves < 1)
+			{
+				cerr << "Error: <N> must be > 0.\n";
+				return 1;
+			}
+			break;
+		case THREADS_OPTION:
+			if (!integer_argument(optarg, factor_threads))
+				return 1;
+			if (factor_threads < 1)
+			{
+				cerr << "Error: <N> must be > 0.\n";
+				return 1;
+			}
+			break;
+#ifdef FACTOR
+		case FACTOR_BACKEND_OPTION:
+			backend = xargmatch("--factor-backend", optarg, factor_backend_args, size(factor_backend_args), factor_backend_types);
+			break;
+		case FACTOR_THRESHOLD_OPTION:
+			if (!integer_argument(optarg, factor_threshold))
+				return 1;
+			break;
+		case CALIBRATE_OPTION:
+			calibrating = true;
+			break;
+#endif
+		case RANGE_OPTION:
+			ranging = true;
+			if (!range_arguments("--range", argc, argv, range_start, range_end))
+				return 1;
+			if (range_start < 1)
+			{
+				cerr << "Error: <START> must be > 0.\n";
+				return 1;
+			}
+			break;
+		case PRIMES_OPTION:
+			if (listing and listing != c)
+			{
+				cerr << "Usage: --primes and --prime-count cannot be used together\n";
+				return 1;
+			}
+			listing = c;
+			if (!range_arguments("--primes", argc, argv, range_start, range_end))
+				return 1;
+			break;
+		case PRIME_COUNT_OPTION:
+			if (listing and listing != c)
+			{
+				cerr << "Usage: --primes and --prime-count cannot be used together\n";
+				return 1;
+			}
+			listing = c;
+			if (!integer_argument(optarg, prime_count_x))
+				return 1;
+			if (prime_count_x > PRIME_COUNT_MAX)
+			{
+				cerr << "Error: <X> must be ≤ 10^20.\n";
+				return 1;
+			}
+			break;
 		case 'x':
 			tobase = 16;
 			break;
@@ -2604,6 +6789,36 @@ int main(int argc, char *argv[])
 		}
 	}
 
+#ifdef FACTOR
+	if (calibrating)
+		return calibrate();
+#endif
+
+	if (listing == PRIME_COUNT_OPTION)
+	{
+		if (!integer or tobase or ranging or arg or special or print_exponents or optind < argc)
+		{
+			cerr << "Usage: --prime-count does not take any other numbers or output options\n";
+			return 1;
+		}
+		cout << outputbase(prime_count_x) << ": " << outputbase(prime_counter(prime_count_x).count(prime_count_x)) << '\n';
+		return 0;
+	}
+
+	if (listing == PRIMES_OPTION)
+	{
+		if (!integer or tobase or ranging or arg or special or print_exponents or optind < argc)
+		{
+			cerr << "Usage: --primes does not take any other numbers or output options\n";
+			return 1;
+		}
+		outputprimes(cout, range_start, range_end);
+		return 0;
+	}
+
+	if (!arg)
+		arg = 'a';
+
 	if (integer)
 	{
 		if (arg == 'c')
@@ -2614,7 +6829,7 @@ int main(int argc, char *argv[])
 	}
 	else
 	{
-		if (frombase or tobase or arg == 'r' or arg == 'g' or arg == 'm' or arg == BRAILLE_OPTION or arg == 't' or arg == 'p' or arg == 'd' or arg == 's' or arg == 'n')
+		if (frombase or tobase or arg == 'r' or arg == 'g' or arg == 'm' or arg == BRAILLE_OPTION or arg == 't' or arg == 'p' or arg == 'd' or arg == 's' or arg == SIGMA_OPTION or arg == TAU_OPTION or arg == TOTIENT_OPTION or arg == KTH_DIVISOR_OPTION or arg == DIVISORS_BETWEEN_OPTION or arg == LARGEST_DIVISOR_OPTION or arg == 'n')
 		{
 			cerr << "Usage: Option not available for floating point numbers.\n";
 			return 1;
@@ -2633,15 +6848,54 @@ int main(int argc, char *argv[])
 		return 1;
 	}
 
+	if (ranging)
+	{
+		if (!integer or tobase or (arg != 'p' and arg != 'd' and arg != 's' and arg != 'n'))
+		{
+			cerr << "Usage: --range is only available for integer numbers with --factors, --divisors, --aliquot and --prime\n";
+			return 1;
+		}
+		if (optind < argc)
+		{
+			cerr << "Usage: --range does not take any other numbers\n";
+			return 1;
+		}
+		return integers_range(range_start, range_end, unicode, print_exponents, arg);
+	}
+
+	/* Test if numbers are prime in batches, except when reading them interactively.  */
+	const bool batch = integer and arg == 'n' and !tobase;
+
 	if (optind < argc)
 	{
-		for (int i = optind; i < argc; ++i)
+		if (batch)
+			integers_batch(vector<string>(argv + optind, argv + argc), frombase, tobase, unicode, uppercase, special, print_exponents, scale_to, unit_separator, arg);
+		else
 		{
-			if (integer)
-				integers(argv[i], frombase, tobase, unicode, uppercase, special, print_exponents, scale_to, unit_separator, arg);
-			else
-				floats(argv[i], scale_to, unit_separator, arg);
+			for (int i = optind; i < argc; ++i)
+			{
+				if (integer)
+					integers(argv[i], frombase, tobase, unicode, uppercase, special, print_exponents, scale_to, unit_separator, arg);
+				else
+					floats(argv[i], scale_to, unit_separator, arg);
+			}
+		}
+	}
+	else if (batch and !isatty(STDIN_FILENO))
+	{
+		vector<string> tokens;
+		tokens.reserve(BATCH_SIZE);
+		string token;
+		while (cin >> token)
+		{
+			tokens.push_back(token);
+			if (tokens.size() == BATCH_SIZE)
+			{
+				integers_batch(tokens, frombase, tobase, unicode, uppercase, special, print_exponents, scale_to, unit_separator, arg);
+				tokens.clear();
+			}
 		}
+		integers_batch(tokens, frombase, tobase, unicode, uppercase, special, print_exponents, scale_to, unit_separator, arg);
 	}
 	else
 	{